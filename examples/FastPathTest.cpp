@@ -0,0 +1,467 @@
+// ======================================================================
+/*!
+ * \brief Compare the optimized code paths with the plain implementations
+ *
+ * Checks that
+ *
+ *  - indexed metadata queries return the same models as filtering the
+ *    full metadata list with the MetaQueryFilters
+ *  - aggregating over a grid mask gives the same statistics as
+ *    interpolating the masked points one by one
+ *  - sampling into a new grid gives the same values as interpolating
+ *    the new grid points one by one
+ *  - fused time interpolation of a grid gives the same values as the
+ *    newbase grid interpolation
+ *
+ * Usage: FastPathTest [querydata files]
+ *
+ * Without arguments the querydata in ../../../data/pal is used, and
+ * the test is skipped if there is none.
+ */
+// ======================================================================
+
+#include "GridMask.h"
+#include "MetaQueryFilters.h"
+#include "MetaQueryOptions.h"
+#include "Model.h"
+#include "Q.h"
+#include "Repository.h"
+#include <gis/SpatialReference.h>
+#include <macgyver/DateTime.h>
+#include <macgyver/LocalDateTime.h>
+#include <newbase/NFmiFastQueryInfo.h>
+#include <ogr_geometry.h>
+#include <spine/Parameter.h>
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace SmartMet;
+using namespace SmartMet::Engine::Querydata;
+
+const string default_directory = "../../../data/pal";
+
+// Relative tolerance for values calculated in a different order
+const double tolerance = 1e-3;
+
+int errors = 0;
+
+void adderrorreal(int line, const string& test, const string& err)
+{
+  ++errors;
+  cerr << "Test " << test << " failed(" << __FILE__ << ":" << line << "): " << err << endl;
+}
+
+// We have to have this as macro since the variable is not defined at this point
+#define adderror(str) adderrorreal(__LINE__, test, str)
+
+bool close_enough(double value, double expected)
+{
+  if (value == kFloatMissing || expected == kFloatMissing)
+    return value == expected;
+  return std::abs(value - expected) <= tolerance * std::max(1.0, std::abs(expected));
+}
+
+// Prefer temperature as a typical linearly interpolated parameter
+FmiParameterName choose_parameter(const Q& q)
+{
+  if (q->param(kFmiTemperature))
+    return kFmiTemperature;
+  q->resetParam();
+  q->nextParam();
+  return q->parameterName();
+}
+
+// Midway between the first two timesteps to test time interpolation too
+Fmi::DateTime choose_time(const MetaData& meta)
+{
+  if (meta.times.size() < 2)
+    return meta.firstTime;
+  const auto& t1 = meta.times.front();
+  const auto& t2 = *std::next(meta.times.begin());
+  return t1 + (t2 - t1) / 2;
+}
+
+// A lon/lat rectangle around the center of the data covering the given fraction of it
+struct Box
+{
+  double xmin;
+  double ymin;
+  double xmax;
+  double ymax;
+};
+
+Box central_box(const MetaData& meta, double theFraction)
+{
+  const auto lon1 = std::min({meta.bllon, meta.ullon, meta.brlon, meta.urlon});
+  const auto lon2 = std::max({meta.bllon, meta.ullon, meta.brlon, meta.urlon});
+  const auto lat1 = std::min({meta.bllat, meta.ullat, meta.brlat, meta.urlat});
+  const auto lat2 = std::max({meta.bllat, meta.ullat, meta.brlat, meta.urlat});
+  const auto dx = theFraction * (lon2 - lon1) / 2;
+  const auto dy = theFraction * (lat2 - lat1) / 2;
+  return Box{meta.clon - dx, meta.clat - dy, meta.clon + dx, meta.clat + dy};
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Compare indexed metadata queries with filtering the full list
+ */
+// ----------------------------------------------------------------------
+
+vector<string> keys(const list<MetaData>& theMetaData)
+{
+  vector<string> ret;
+  for (const auto& meta : theMetaData)
+    ret.push_back(meta.producer + " " + Fmi::to_iso_string(meta.originTime));
+  std::sort(ret.begin(), ret.end());
+  return ret;
+}
+
+list<MetaData> filter(const list<MetaData>& theMetaData, const MetaQueryOptions& theOptions)
+{
+  list<MetaData> ret;
+  for (const auto& meta : theMetaData)
+  {
+    if (filterProducer(meta, theOptions) && filterOriginTime(meta, theOptions) &&
+        filterFirstTime(meta, theOptions) && filterLastTime(meta, theOptions) &&
+        filterParameters(meta, theOptions) && filterLevelTypes(meta, theOptions) &&
+        filterLevelValues(meta, theOptions) && filterBoundingBox(meta, theOptions))
+      ret.push_back(meta);
+  }
+  return ret;
+}
+
+void test_metadata(const Repository& theRepo)
+{
+  const string test = "metadata";
+
+  const auto all = theRepo.getRepoMetadata();
+  if (all.empty())
+  {
+    adderror("repository has no metadata");
+    return;
+  }
+
+  const auto& meta = all.front();
+
+  vector<pair<string, MetaQueryOptions>> queries;
+
+  queries.emplace_back("no options", MetaQueryOptions());
+
+  {
+    MetaQueryOptions options;
+    options.setProducer(meta.producer);
+    queries.emplace_back("producer", options);
+  }
+  {
+    MetaQueryOptions options;
+    options.setProducer("nosuchproducer");
+    queries.emplace_back("unknown producer", options);
+  }
+  {
+    MetaQueryOptions options;
+    options.setOriginTime(meta.originTime);
+    queries.emplace_back("origin time", options);
+  }
+  {
+    MetaQueryOptions options;
+    options.setFirstTime(meta.firstTime);
+    options.setLastTime(meta.lastTime);
+    queries.emplace_back("first and last time", options);
+  }
+  if (!meta.parameters.empty())
+  {
+    MetaQueryOptions options;
+    options.addParameter(meta.parameters.front().name);
+    queries.emplace_back("parameter", options);
+  }
+  if (!meta.levels.empty())
+  {
+    MetaQueryOptions options;
+    options.addLevelType(meta.levels.front().type);
+    options.addLevelValue(meta.levels.front().value);
+    queries.emplace_back("level", options);
+  }
+  {
+    const auto box = central_box(meta, 0.2);
+    MetaQueryOptions options;
+    options.setBoundingBox(NFmiPoint(box.xmin, box.ymin), NFmiPoint(box.xmax, box.ymax));
+    queries.emplace_back("bounding box", options);
+  }
+
+  for (const auto& query : queries)
+  {
+    const auto indexed = keys(theRepo.getRepoMetadata(query.second));
+    const auto scanned = keys(filter(all, query.second));
+    if (indexed != scanned)
+      adderror("indexed and filtered results differ for query '" + query.first + "': " +
+               to_string(indexed.size()) + " vs " + to_string(scanned.size()) + " models");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Compare the grid mask aggregate with interpolating each masked point
+ */
+// ----------------------------------------------------------------------
+
+void test_aggregate(const Q& q)
+{
+  const string test = "aggregate";
+
+  const auto meta = q->metaData();
+  const auto param = choose_parameter(q);
+
+  const auto box = central_box(meta, 0.2);
+  const auto wkt = "POLYGON ((" + to_string(box.xmin) + " " + to_string(box.ymin) + "," +
+                   to_string(box.xmax) + " " + to_string(box.ymin) + "," +
+                   to_string(box.xmax) + " " + to_string(box.ymax) + "," +
+                   to_string(box.xmin) + " " + to_string(box.ymax) + "," +
+                   to_string(box.xmin) + " " + to_string(box.ymin) + "))";
+
+  OGRGeometry* geom = nullptr;
+  if (OGRGeometryFactory::createFromWkt(wkt.c_str(), nullptr, &geom) != OGRERR_NONE)
+  {
+    adderror("failed to create polygon " + wkt);
+    return;
+  }
+  std::unique_ptr<OGRGeometry, void (*)(OGRGeometry*)> polygon(
+      geom, OGRGeometryFactory::destroyGeometry);
+
+  GridMaskPtr mask = GridMask::create(q, *polygon);
+  if (mask->empty())
+  {
+    adderror("no grid points inside " + wkt);
+    return;
+  }
+
+  TS::TimeSeriesGenerator::LocalTimeList times;
+  times.emplace_back(meta.firstTime, Fmi::TimeZonePtr::utc);
+  times.emplace_back(choose_time(meta), Fmi::TimeZonePtr::utc);
+
+  const auto result = q->aggregate(param, mask, times);
+
+  q->param(param);
+
+  std::size_t i = 0;
+  for (const auto& ldt : times)
+  {
+    const NFmiMetTime t = ldt;
+    const auto& stats = result[i++];
+
+    std::size_t count = 0;
+    std::size_t missing = 0;
+    double minimum = kFloatMissing;
+    double maximum = kFloatMissing;
+    double sum = 0;
+    double weights = 0;
+
+    std::size_t k = 0;
+    for (const auto& run : mask->runs())
+    {
+      for (auto idx = run.start; idx < run.start + run.length; idx++)
+      {
+        const double weight = mask->weights()[k++];
+        const double value = q->interpolate(q->latLon(idx), t);
+        if (value == kFloatMissing)
+        {
+          ++missing;
+          continue;
+        }
+        minimum = (count == 0 ? value : std::min(minimum, value));
+        maximum = (count == 0 ? value : std::max(maximum, value));
+        sum += weight * value;
+        weights += weight;
+        ++count;
+      }
+    }
+
+    const double mean = (count == 0 ? kFloatMissing : sum / weights);
+    const auto when = Fmi::to_iso_string(t.PosixTime());
+
+    if (stats.count != count || stats.missing != missing)
+      adderror(when + ": expected " + to_string(count) + " values and " + to_string(missing) +
+               " missing, got " + to_string(stats.count) + " and " + to_string(stats.missing));
+    if (!close_enough(stats.min, minimum) || !close_enough(stats.max, maximum))
+      adderror(when + ": expected range " + to_string(minimum) + "..." + to_string(maximum) +
+               ", got " + to_string(stats.min) + "..." + to_string(stats.max));
+    if (!close_enough(stats.mean, mean))
+      adderror(when + ": expected mean " + to_string(mean) + ", got " + to_string(stats.mean));
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Compare sampling with interpolating each new grid point
+ */
+// ----------------------------------------------------------------------
+
+void test_sample(const Q& q)
+{
+  const string test = "sample";
+
+  const auto meta = q->metaData();
+  const auto param = choose_parameter(q);
+  const auto t = choose_time(meta);
+  const auto box = central_box(meta, 0.5);
+
+  // At most a few hundred points in each direction to keep the test fast
+  const double resolution = std::max(meta.xResolution / 2, meta.areaWidth / 2 / 200);
+
+  const Spine::Parameter parameter(
+      q->param().GetParamName().CharPtr(), Spine::Parameter::Type::Data, param);
+  const Fmi::SpatialReference crs("WGS84");
+
+  const auto sampled =
+      q->sample(parameter, t, crs, box.xmin, box.ymin, box.xmax, box.ymax, resolution);
+
+  if (!sampled->param(param))
+  {
+    adderror("sampled data does not contain the parameter");
+    return;
+  }
+  sampled->firstTime();
+  q->param(param);
+
+  const NFmiMetTime mettime(t);
+  auto info = sampled->info();
+  const auto n = info->SizeLocations();
+
+  std::size_t failures = 0;
+  for (unsigned long idx = 0; idx < n; idx++)
+  {
+    info->LocationIndex(idx);
+    const double value = info->FloatValue();
+    const double expected = q->interpolate(info->LatLon(), mettime);
+    if (!close_enough(value, expected) && ++failures <= 10)
+      adderror("at " + to_string(info->LatLon().X()) + "," + to_string(info->LatLon().Y()) +
+               " expected " + to_string(expected) + ", got " + to_string(value));
+  }
+
+  if (failures > 10)
+    adderror(to_string(failures) + " of " + to_string(n) + " sampled values differ");
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Compare fused time interpolation with the newbase implementation
+ */
+// ----------------------------------------------------------------------
+
+void test_time_interpolation(const Q& q)
+{
+  const string test = "time interpolation";
+
+  const auto meta = q->metaData();
+  const auto param = choose_parameter(q);
+  const auto t = choose_time(meta);
+
+  q->param(param);
+  const auto values = q->nanValues(t);
+  const auto expected = q->values(NFmiMetTime(t));
+
+  if (values.NX() != expected.NX() || values.NY() != expected.NY())
+  {
+    adderror("expected a " + to_string(expected.NX()) + "x" + to_string(expected.NY()) +
+             " grid, got " + to_string(values.NX()) + "x" + to_string(values.NY()));
+    return;
+  }
+
+  std::size_t failures = 0;
+  for (std::size_t j = 0; j < expected.NY(); j++)
+    for (std::size_t i = 0; i < expected.NX(); i++)
+    {
+      const double value = (std::isnan(values[i][j]) ? kFloatMissing : values[i][j]);
+      if (!close_enough(value, expected[i][j]) && ++failures <= 10)
+        adderror("at " + to_string(i) + "," + to_string(j) + " expected " +
+                 to_string(expected[i][j]) + ", got " + to_string(value));
+    }
+
+  if (failures > 10)
+    adderror(to_string(failures) + " grid values differ");
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Find the querydata to test
+ */
+// ----------------------------------------------------------------------
+
+vector<std::filesystem::path> find_files(int argc, char* argv[])
+{
+  vector<std::filesystem::path> files;
+  for (int i = 1; i < argc; i++)
+    files.emplace_back(argv[i]);
+
+  if (!files.empty())
+    return files;
+
+  std::error_code ec;
+  for (const auto& entry : std::filesystem::directory_iterator(default_directory, ec))
+  {
+    const auto ext = entry.path().extension();
+    if (entry.is_regular_file() && (ext == ".sqd" || ext == ".fqd"))
+      files.push_back(entry.path());
+  }
+  std::sort(files.begin(), files.end());
+  return files;
+}
+
+int main(int argc, char* argv[])
+{
+  try
+  {
+    const auto files = find_files(argc, argv);
+    if (files.empty())
+    {
+      cout << "FastPathTest: no querydata in " << default_directory << ", skipping" << endl;
+      return 0;
+    }
+
+    Repository repo;
+
+    for (const auto& file : files)
+    {
+      cout << "FastPathTest: " << file.string() << endl;
+
+      // Each file is a producer of its own so that the metadata queries have something to filter
+      const Producer producer = file.stem().string();
+      auto model = Model::create(file, producer, "", false, false, false, false, 0, 0, true);
+
+      ProducerConfig config;
+      config.producer = producer;
+      repo.add(config);
+      repo.add(producer, model);
+
+      auto q = std::make_shared<QImpl>(model);
+      if (!q->isGrid())
+        continue;
+
+      test_aggregate(q);
+      test_sample(q);
+      test_time_interpolation(q);
+    }
+
+    test_metadata(repo);
+  }
+  catch (std::exception& e)
+  {
+    cerr << "Exception: " << e.what() << endl;
+    return 1;
+  }
+
+  if (errors > 0)
+  {
+    cerr << errors << " errors" << endl;
+    return 1;
+  }
+
+  cout << "FastPathTest: all tests passed" << endl;
+  return 0;
+}
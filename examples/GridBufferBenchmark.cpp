@@ -0,0 +1,201 @@
+// ======================================================================
+/*!
+ * \brief Compare GridBuffer and NFmiDataMatrix<float>
+ *
+ * Measures the number of heap allocations and the throughput of
+ * creating, filling and summing grids with both types, and the cost
+ * of converting between them.
+ *
+ * Usage: GridBufferBenchmark [width] [height] [repeats]
+ *
+ * Not run by make test, build and run it with make GridBufferBenchmark.
+ *
+ * The examples are built without optimization by default, build with
+ * for example make CFLAGS="-O2 -DUNIX" for representative throughput.
+ */
+// ======================================================================
+
+#include "GridBuffer.h"
+#include <newbase/NFmiDataMatrix.h>
+#include <chrono>
+#include <cstdlib>
+#include <dlfcn.h>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+
+using namespace std;
+using SmartMet::Engine::Querydata::GridBuffer;
+
+// Count heap allocations made through operator new and aligned_alloc
+
+static std::size_t g_allocations = 0;
+
+void* operator new(std::size_t n)
+{
+  ++g_allocations;
+  if (void* ptr = std::malloc(n == 0 ? 1 : n))
+    return ptr;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t /* n */) noexcept
+{
+  std::free(ptr);
+}
+
+extern "C" void* aligned_alloc(std::size_t alignment, std::size_t n)
+{
+  using AlignedAlloc = void* (*)(std::size_t, std::size_t);
+  static auto real = reinterpret_cast<AlignedAlloc>(dlsym(RTLD_NEXT, "aligned_alloc"));
+  ++g_allocations;
+  return real(alignment, n);
+}
+
+// Timing and reporting
+
+class Measurement
+{
+ public:
+  explicit Measurement(string theName)
+      : itsName(std::move(theName)),
+        itsAllocations(g_allocations),
+        itsStart(chrono::steady_clock::now())
+  {
+  }
+
+  void report(std::size_t theRepeats, std::size_t thePoints) const
+  {
+    const auto elapsed = chrono::steady_clock::now() - itsStart;
+    const double secs = chrono::duration<double>(elapsed).count();
+    const double mpoints = 1e-6 * static_cast<double>(theRepeats * thePoints) / secs;
+
+    cout << left << setw(32) << itsName << right << setw(12)
+         << (g_allocations - itsAllocations) / theRepeats << " allocs/grid" << setw(12)
+         << fixed << setprecision(1) << mpoints << " Mpoints/s" << endl;
+  }
+
+ private:
+  string itsName;
+  std::size_t itsAllocations;
+  chrono::steady_clock::time_point itsStart;
+};
+
+// Prevent the compiler from optimizing the loops away
+static volatile double g_sink = 0;
+
+int main(int argc, char* argv[])
+{
+  const std::size_t nx = (argc > 1 ? stoul(argv[1]) : 1000);
+  const std::size_t ny = (argc > 2 ? stoul(argv[2]) : 1000);
+  const std::size_t repeats = (argc > 3 ? stoul(argv[3]) : 20);
+  const std::size_t npoints = nx * ny;
+
+  cout << "Grid " << nx << "x" << ny << ", " << repeats << " repeats" << endl << endl;
+
+  // Allocation
+
+  {
+    Measurement m("NFmiDataMatrix construct");
+    for (std::size_t r = 0; r < repeats; r++)
+    {
+      NFmiDataMatrix<float> matrix(nx, ny, kFloatMissing);
+      g_sink = g_sink + matrix[0][0];
+    }
+    m.report(repeats, npoints);
+  }
+
+  {
+    Measurement m("GridBuffer construct");
+    for (std::size_t r = 0; r < repeats; r++)
+    {
+      GridBuffer buffer(nx, ny, kFloatMissing);
+      g_sink = g_sink + buffer[0];
+    }
+    m.report(repeats, npoints);
+  }
+
+  // Filling in querydata location order, as the engine does
+
+  NFmiDataMatrix<float> matrix(nx, ny, kFloatMissing);
+  GridBuffer buffer(nx, ny, kFloatMissing);
+
+  {
+    Measurement m("NFmiDataMatrix fill");
+    for (std::size_t r = 0; r < repeats; r++)
+      for (std::size_t j = 0; j < ny; j++)
+        for (std::size_t i = 0; i < nx; i++)
+          matrix[i][j] = static_cast<float>(i + j + r);
+    m.report(repeats, npoints);
+  }
+
+  {
+    Measurement m("GridBuffer fill");
+    for (std::size_t r = 0; r < repeats; r++)
+      for (std::size_t j = 0; j < ny; j++)
+      {
+        float* row = buffer.row(j);
+        for (std::size_t i = 0; i < nx; i++)
+          row[i] = static_cast<float>(i + j + r);
+      }
+    m.report(repeats, npoints);
+  }
+
+  // Reading
+
+  {
+    Measurement m("NFmiDataMatrix sum");
+    for (std::size_t r = 0; r < repeats; r++)
+    {
+      double sum = 0;
+      for (std::size_t j = 0; j < ny; j++)
+        for (std::size_t i = 0; i < nx; i++)
+          sum += matrix[i][j];
+      g_sink = g_sink + sum;
+    }
+    m.report(repeats, npoints);
+  }
+
+  {
+    Measurement m("GridBuffer sum");
+    for (std::size_t r = 0; r < repeats; r++)
+    {
+      double sum = 0;
+      const float* data = buffer.data();
+      for (std::size_t k = 0; k < buffer.size(); k++)
+        sum += data[k];
+      g_sink = g_sink + sum;
+    }
+    m.report(repeats, npoints);
+  }
+
+  // Adapters
+
+  {
+    Measurement m("GridBuffer::fromMatrix");
+    for (std::size_t r = 0; r < repeats; r++)
+    {
+      auto tmp = GridBuffer::fromMatrix(matrix);
+      g_sink = g_sink + tmp[0];
+    }
+    m.report(repeats, npoints);
+  }
+
+  {
+    Measurement m("GridBuffer::toMatrix");
+    for (std::size_t r = 0; r < repeats; r++)
+    {
+      auto tmp = buffer.toMatrix();
+      g_sink = g_sink + tmp[0][0];
+    }
+    m.report(repeats, npoints);
+  }
+
+  return 0;
+}
@@ -0,0 +1,43 @@
+// ======================================================================
+/*!
+ * \brief Statistics of a parameter over an area for one timestep
+ */
+// ======================================================================
+
+#pragma once
+
+#include <macgyver/LocalDateTime.h>
+#include <newbase/NFmiGlobals.h>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Querydata
+{
+struct AreaStatistics
+{
+  explicit AreaStatistics(const Fmi::LocalDateTime& theTime) : time(theTime) {}
+
+  Fmi::LocalDateTime time;
+  std::size_t count = 0;    // number of valid values
+  std::size_t missing = 0;  // number of missing values
+
+  // kFloatMissing if there are no valid values. When aggregating over a
+  // GridMask the mean is weighted by the cell areas and the sum is the
+  // sum of the values multiplied by the cell areas in square kilometers.
+  double min = kFloatMissing;
+  double max = kFloatMissing;
+  double mean = kFloatMissing;
+  double sum = kFloatMissing;
+
+  // In the same order as the requested percentiles
+  std::vector<double> percentiles;
+};
+
+using AreaStatisticsList = std::vector<AreaStatistics>;
+
+}  // namespace Querydata
+}  // namespace Engine
+}  // namespace SmartMet
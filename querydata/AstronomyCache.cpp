@@ -0,0 +1,113 @@
+#include "AstronomyCache.h"
+#include <macgyver/Exception.h>
+#include <macgyver/Hash.h>
+#include <cmath>
+#include <string>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Querydata
+{
+namespace
+{
+using SolarTimeCache = Fmi::Cache::Cache<std::size_t, AstronomyCache::SolarTime>;
+using LunarTimeCache = Fmi::Cache::Cache<std::size_t, AstronomyCache::LunarTime>;
+
+SolarTimeCache g_SolarTimeCache{AstronomyCache::default_cache_size};
+LunarTimeCache g_LunarTimeCache{AstronomyCache::default_cache_size};
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Cache key for astronomical events
+ *
+ * The events depend only on the local date and the time zone. The
+ * zone is identified by its name, since abbreviations and offsets are
+ * shared by zones with different daylight saving rules, and the events
+ * are reported in the zone. The coordinates are rounded to about 10
+ * meters, which changes the event times by a small fraction of a second.
+ */
+// ----------------------------------------------------------------------
+
+std::size_t event_hash(const Fmi::LocalDateTime& theTime, double theLon, double theLat)
+{
+  const auto local_time = theTime.local_time();
+  const std::string zone = (theTime.zone() ? theTime.zone()->name() : std::string("UTC"));
+
+  std::size_t hash = Fmi::hash_value(std::round(theLon * 10000));
+  Fmi::hash_combine(hash, Fmi::hash_value(std::round(theLat * 10000)));
+  Fmi::hash_combine(hash, Fmi::hash_value(Fmi::DateTime(local_time.date())));
+  Fmi::hash_combine(hash, Fmi::hash_value(zone));
+  return hash;
+}
+
+}  // namespace
+
+namespace AstronomyCache
+{
+// Return cached solar events or calculate and cache them
+SolarTime solar_time(const Fmi::LocalDateTime& theTime, double theLon, double theLat)
+{
+  try
+  {
+    const auto hash = event_hash(theTime, theLon, theLat);
+
+    const auto cached = g_SolarTimeCache.find(hash);
+    if (cached)
+      return *cached;
+
+    auto stime = std::make_shared<const Fmi::Astronomy::solar_time_t>(
+        Fmi::Astronomy::solar_time(theTime, theLon, theLat));
+    g_SolarTimeCache.insert(hash, stime);
+    return stime;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// Return cached lunar events or calculate and cache them
+LunarTime lunar_time(const Fmi::LocalDateTime& theTime, double theLon, double theLat)
+{
+  try
+  {
+    const auto hash = event_hash(theTime, theLon, theLat);
+
+    const auto cached = g_LunarTimeCache.find(hash);
+    if (cached)
+      return *cached;
+
+    auto ltime = std::make_shared<const Fmi::Astronomy::lunar_time_t>(
+        Fmi::Astronomy::lunar_time(theTime, theLon, theLat));
+    g_LunarTimeCache.insert(hash, ltime);
+    return ltime;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// Resize the caches from the default
+void SetCacheSize(std::size_t newMaxSize)
+{
+  g_SolarTimeCache.resize(newMaxSize);
+  g_LunarTimeCache.resize(newMaxSize);
+}
+
+Fmi::Cache::CacheStats getSolarCacheStats()
+{
+  return g_SolarTimeCache.statistics();
+}
+
+Fmi::Cache::CacheStats getLunarCacheStats()
+{
+  return g_LunarTimeCache.statistics();
+}
+
+}  // namespace AstronomyCache
+}  // namespace Querydata
+}  // namespace Engine
+}  // namespace SmartMet
@@ -0,0 +1,44 @@
+// ======================================================================
+/*!
+ * \brief Memoized solar and lunar event calculations
+ *
+ * Sunrise, sunset, moonrise etc depend only on the location and the
+ * local date, not on the time of day. Timeseries requests ask for the
+ * same events for every timestep of the day, hence we cache them.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <macgyver/Astronomy.h>
+#include <macgyver/Cache.h>
+#include <macgyver/LocalDateTime.h>
+#include <memory>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Querydata
+{
+namespace AstronomyCache
+{
+using SolarTime = std::shared_ptr<const Fmi::Astronomy::solar_time_t>;
+using LunarTime = std::shared_ptr<const Fmi::Astronomy::lunar_time_t>;
+
+SolarTime solar_time(const Fmi::LocalDateTime& theTime, double theLon, double theLat);
+
+LunarTime lunar_time(const Fmi::LocalDateTime& theTime, double theLon, double theLat);
+
+// A day of hourly data at a few thousand locations
+const std::size_t default_cache_size = 10000;
+
+void SetCacheSize(std::size_t newMaxSize);
+
+Fmi::Cache::CacheStats getSolarCacheStats();
+Fmi::Cache::CacheStats getLunarCacheStats();
+
+}  // namespace AstronomyCache
+}  // namespace Querydata
+}  // namespace Engine
+}  // namespace SmartMet
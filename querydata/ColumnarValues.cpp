@@ -0,0 +1,69 @@
+#include "ColumnarValues.h"
+#include <macgyver/Exception.h>
+#include <newbase/NFmiGlobals.h>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Querydata
+{
+// ----------------------------------------------------------------------
+/*!
+ * \brief Convert a timeseries time list into a shareable time axis
+ */
+// ----------------------------------------------------------------------
+
+ColumnarValues::TimeAxisPtr ColumnarValues::makeTimeAxis(
+    const TS::TimeSeriesGenerator::LocalTimeList& theTimes)
+{
+  try
+  {
+    return std::make_shared<const TimeAxis>(theTimes.begin(), theTimes.end());
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Allocate storage with all values initially missing
+ */
+// ----------------------------------------------------------------------
+
+ColumnarValues::ColumnarValues(TimeAxisPtr theTimes, std::vector<TS::LonLat> theLonLats)
+    : itsTimes(std::move(theTimes)), itsLonLats(std::move(theLonLats))
+{
+  try
+  {
+    if (!itsTimes)
+      throw Fmi::Exception(BCP, "Columnar values require a time axis");
+
+    const auto n = itsTimes->size() * itsLonLats.size();
+    itsValues.resize(n, kFloatMissing);
+    itsMissing.resize(n, true);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Set a value, kFloatMissing leaves the value marked missing
+ */
+// ----------------------------------------------------------------------
+
+void ColumnarValues::set(std::size_t theLocation, std::size_t theTime, float theValue)
+{
+  const auto pos = theLocation * timeCount() + theTime;
+  itsValues[pos] = theValue;
+  itsMissing[pos] = (theValue == kFloatMissing);
+}
+
+}  // namespace Querydata
+}  // namespace Engine
+}  // namespace SmartMet
@@ -0,0 +1,77 @@
+// ======================================================================
+/*!
+ * \brief Dense timeseries values for many locations
+ *
+ * An alternative to TS::TimeSeriesGroup for large extractions. The
+ * time axis is stored once and may be shared by several parameters,
+ * the values are stored as a dense float array with one row of
+ * timesteps per location, and missing values are marked in a bitmap.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <macgyver/LocalDateTime.h>
+#include <timeseries/TimeSeriesInclude.h>
+#include <memory>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Querydata
+{
+class ColumnarValues
+{
+ public:
+  using TimeAxis = std::vector<Fmi::LocalDateTime>;
+  using TimeAxisPtr = std::shared_ptr<const TimeAxis>;
+
+  static TimeAxisPtr makeTimeAxis(const TS::TimeSeriesGenerator::LocalTimeList& theTimes);
+
+  ColumnarValues(TimeAxisPtr theTimes, std::vector<TS::LonLat> theLonLats);
+
+  ~ColumnarValues() = default;
+  ColumnarValues() = delete;
+  ColumnarValues(const ColumnarValues& other) = default;
+  ColumnarValues& operator=(const ColumnarValues& other) = default;
+  ColumnarValues(ColumnarValues&& other) = default;
+  ColumnarValues& operator=(ColumnarValues&& other) = default;
+
+  std::size_t timeCount() const { return itsTimes->size(); }
+  std::size_t locationCount() const { return itsLonLats.size(); }
+
+  const TimeAxisPtr& times() const { return itsTimes; }
+  const TS::LonLat& lonlat(std::size_t theLocation) const { return itsLonLats[theLocation]; }
+
+  // Row of timeCount() values for the location, kFloatMissing where missing
+  const float* row(std::size_t theLocation) const
+  {
+    return itsValues.data() + theLocation * timeCount();
+  }
+
+  float value(std::size_t theLocation, std::size_t theTime) const
+  {
+    return itsValues[theLocation * timeCount() + theTime];
+  }
+
+  bool isMissing(std::size_t theLocation, std::size_t theTime) const
+  {
+    return itsMissing[theLocation * timeCount() + theTime];
+  }
+
+  void set(std::size_t theLocation, std::size_t theTime, float theValue);
+
+ private:
+  TimeAxisPtr itsTimes;
+  std::vector<TS::LonLat> itsLonLats;
+  std::vector<float> itsValues;
+  std::vector<bool> itsMissing;
+};
+
+using ColumnarValuesPtr = std::shared_ptr<ColumnarValues>;
+
+}  // namespace Querydata
+}  // namespace Engine
+}  // namespace SmartMet
@@ -0,0 +1,346 @@
+#include "CoordinateBlob.h"
+#include <macgyver/Exception.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Querydata
+{
+namespace CoordinateBlob
+{
+namespace
+{
+// Increase when the layout changes
+const std::uint32_t blob_version = 1;
+
+const char blob_magic[8] = {'Q', 'D', 'C', 'O', 'O', 'R', 'D', '\0'};
+
+struct Header
+{
+  char magic[8];
+  std::uint32_t version;
+  Kind kind;
+  std::uint64_t key;
+  std::uint64_t width;
+  std::uint64_t height;
+  std::uint64_t complete;  // written last
+};
+
+void write_header(void* theMemory,
+                  Kind theKind,
+                  std::size_t theKey,
+                  std::size_t theWidth,
+                  std::size_t theHeight)
+{
+  auto* header = static_cast<Header*>(theMemory);
+  std::memcpy(header->magic, blob_magic, sizeof(blob_magic));
+  header->version = blob_version;
+  header->kind = theKind;
+  header->key = theKey;
+  header->width = theWidth;
+  header->height = theHeight;
+  header->complete = 0;
+}
+
+void set_complete(void* theMemory)
+{
+  auto* header = static_cast<Header*>(theMemory);
+  __atomic_store_n(&header->complete, 1, __ATOMIC_RELEASE);
+}
+
+// Returns the header if the blob is usable
+const Header* validate(const void* theMemory, std::size_t theSize, Kind theKind, std::size_t theKey)
+{
+  if (theMemory == nullptr || theSize < sizeof(Header))
+    return nullptr;
+
+  const auto* header = static_cast<const Header*>(theMemory);
+  if (__atomic_load_n(&header->complete, __ATOMIC_ACQUIRE) != 1)
+    return nullptr;
+
+  if (std::memcmp(header->magic, blob_magic, sizeof(blob_magic)) != 0 ||
+      header->version != blob_version || header->kind != theKind || header->key != theKey)
+    return nullptr;
+
+  // The point count must not overflow and the data must fit into the blob
+  const std::size_t maxpoints = (theSize - sizeof(Header)) / (2 * sizeof(double));
+  if (header->width != 0 && header->height > maxpoints / header->width)
+    return nullptr;
+
+  return header;
+}
+
+const double* values(const void* theMemory)
+{
+  return reinterpret_cast<const double*>(static_cast<const char*>(theMemory) + sizeof(Header));
+}
+
+double* values(void* theMemory)
+{
+  return reinterpret_cast<double*>(static_cast<char*>(theMemory) + sizeof(Header));
+}
+
+std::size_t points(const Fmi::CoordinateMatrix& theData)
+{
+  return theData.width() * theData.height();
+}
+
+std::size_t points(const std::vector<NFmiPoint>& theData)
+{
+  return theData.size();
+}
+
+template <typename Reader>
+auto map_and_read(int theFd, std::size_t theKey, Reader theReader)
+    -> decltype(theReader(nullptr, 0, 0))
+{
+  struct stat st;
+  if (theFd < 0 || fstat(theFd, &st) != 0 || st.st_size <= 0)
+    return {};
+
+  const auto n = static_cast<std::size_t>(st.st_size);
+  void* mem = mmap(nullptr, n, PROT_READ, MAP_SHARED, theFd, 0);
+  if (mem == MAP_FAILED)
+    return {};
+
+  try
+  {
+    auto ret = theReader(mem, n, theKey);
+    munmap(mem, n);
+    return ret;
+  }
+  catch (...)
+  {
+    munmap(mem, n);
+    throw;
+  }
+}
+
+template <typename Data>
+bool map_and_write(int theFd, Kind theKind, std::size_t theKey, const Data& theData)
+{
+  if (theFd < 0)
+    return false;
+
+  // Reserve the space now, writing to a sparse mapping on a full file system raises SIGBUS
+  const auto n = size(points(theData));
+  if (posix_fallocate(theFd, 0, static_cast<off_t>(n)) != 0)
+    return false;
+
+  void* mem = mmap(nullptr, n, PROT_READ | PROT_WRITE, MAP_SHARED, theFd, 0);
+  if (mem == MAP_FAILED)
+    return false;
+
+  try
+  {
+    write(mem, theKind, theKey, theData);
+    munmap(mem, n);
+    return true;
+  }
+  catch (...)
+  {
+    munmap(mem, n);
+    throw;
+  }
+}
+
+}  // namespace
+
+std::uint32_t version()
+{
+  return blob_version;
+}
+
+std::size_t size(std::size_t thePoints)
+{
+  return sizeof(Header) + 2 * thePoints * sizeof(double);
+}
+
+void write(void* theMemory, Kind theKind, std::size_t theKey, const Fmi::CoordinateMatrix& theData)
+{
+  try
+  {
+    const auto nx = theData.width();
+    const auto ny = theData.height();
+    write_header(theMemory, theKind, theKey, nx, ny);
+
+    double* ptr = values(theMemory);
+    for (std::size_t j = 0; j < ny; j++)
+      for (std::size_t i = 0; i < nx; i++)
+      {
+        *ptr++ = theData.x(i, j);
+        *ptr++ = theData.y(i, j);
+      }
+
+    set_complete(theMemory);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+void write(void* theMemory, Kind theKind, std::size_t theKey, const std::vector<NFmiPoint>& theData)
+{
+  try
+  {
+    write_header(theMemory, theKind, theKey, theData.size(), 1);
+
+    double* ptr = values(theMemory);
+    for (const auto& p : theData)
+    {
+      *ptr++ = p.X();
+      *ptr++ = p.Y();
+    }
+
+    set_complete(theMemory);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+std::shared_ptr<Fmi::CoordinateMatrix> readCoordinates(const void* theMemory,
+                                                       std::size_t theSize,
+                                                       std::size_t theKey,
+                                                       std::size_t theWidth,
+                                                       std::size_t theHeight)
+{
+  try
+  {
+    const auto* header = validate(theMemory, theSize, Kind::Coordinates, theKey);
+    if (header == nullptr || header->width != theWidth || header->height != theHeight)
+      return {};
+
+    const std::size_t nx = header->width;
+    const std::size_t ny = header->height;
+    auto ret = std::make_shared<Fmi::CoordinateMatrix>(nx, ny);
+
+    const double* ptr = values(theMemory);
+    for (std::size_t j = 0; j < ny; j++)
+      for (std::size_t i = 0; i < nx; i++)
+      {
+        ret->set(i, j, ptr[0], ptr[1]);
+        ptr += 2;
+      }
+
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+std::shared_ptr<std::vector<NFmiPoint>> readLatLons(const void* theMemory,
+                                                    std::size_t theSize,
+                                                    std::size_t theKey,
+                                                    std::size_t thePoints)
+{
+  try
+  {
+    const auto* header = validate(theMemory, theSize, Kind::LatLons, theKey);
+    if (header == nullptr || header->width != thePoints || header->height != 1)
+      return {};
+
+    const std::size_t n = header->width * header->height;
+    auto ret = std::make_shared<std::vector<NFmiPoint>>();
+    ret->reserve(n);
+
+    const double* ptr = values(theMemory);
+    for (std::size_t i = 0; i < n; i++, ptr += 2)
+      ret->emplace_back(ptr[0], ptr[1]);
+
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+std::shared_ptr<Fmi::CoordinateMatrix> readCoordinates(int theFd,
+                                                       std::size_t theKey,
+                                                       std::size_t theWidth,
+                                                       std::size_t theHeight)
+{
+  try
+  {
+    return map_and_read(theFd,
+                        theKey,
+                        [theWidth, theHeight](const void* mem, std::size_t n, std::size_t key)
+                        { return readCoordinates(mem, n, key, theWidth, theHeight); });
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+std::shared_ptr<std::vector<NFmiPoint>> readLatLons(int theFd,
+                                                    std::size_t theKey,
+                                                    std::size_t thePoints)
+{
+  try
+  {
+    return map_and_read(theFd,
+                        theKey,
+                        [thePoints](const void* mem, std::size_t n, std::size_t key)
+                        { return readLatLons(mem, n, key, thePoints); });
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+bool valid(int theFd, Kind theKind, std::size_t theKey)
+{
+  try
+  {
+    return map_and_read(theFd,
+                        theKey,
+                        [theKind](const void* mem, std::size_t n, std::size_t key)
+                        { return validate(mem, n, theKind, key) != nullptr; });
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+bool write(int theFd, Kind theKind, std::size_t theKey, const Fmi::CoordinateMatrix& theData)
+{
+  try
+  {
+    return map_and_write(theFd, theKind, theKey, theData);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+bool write(int theFd, Kind theKind, std::size_t theKey, const std::vector<NFmiPoint>& theData)
+{
+  try
+  {
+    return map_and_write(theFd, theKind, theKey, theData);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+}  // namespace CoordinateBlob
+}  // namespace Querydata
+}  // namespace Engine
+}  // namespace SmartMet
@@ -0,0 +1,82 @@
+// ======================================================================
+/*!
+ * \brief Binary format for sharing coordinate matrices between processes
+ *
+ * A blob consists of a fixed size header followed by the x and y
+ * coordinates of each point as interleaved doubles. The header records
+ * the format version and the key of the data, and the writer sets the
+ * completion flag last so that readers never use a partial blob.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <gis/CoordinateMatrix.h>
+#include <newbase/NFmiPoint.h>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Querydata
+{
+namespace CoordinateBlob
+{
+enum class Kind : std::uint32_t
+{
+  LatLons = 1,     // std::vector<NFmiPoint> of querydata
+  Coordinates = 2  // projected Fmi::CoordinateMatrix
+};
+
+// Current format version, files of other versions are not readable
+std::uint32_t version();
+
+// Total size of a blob with the given number of points
+std::size_t size(std::size_t thePoints);
+
+// The memory must hold size(points) bytes
+void write(void* theMemory,
+           Kind theKind,
+           std::size_t theKey,
+           const Fmi::CoordinateMatrix& theData);
+void write(void* theMemory,
+           Kind theKind,
+           std::size_t theKey,
+           const std::vector<NFmiPoint>& theData);
+
+// Return empty pointers if the blob is incomplete, of the wrong kind, key, version or
+// size, or not of the size expected by the caller
+std::shared_ptr<Fmi::CoordinateMatrix> readCoordinates(const void* theMemory,
+                                                       std::size_t theSize,
+                                                       std::size_t theKey,
+                                                       std::size_t theWidth,
+                                                       std::size_t theHeight);
+std::shared_ptr<std::vector<NFmiPoint>> readLatLons(const void* theMemory,
+                                                    std::size_t theSize,
+                                                    std::size_t theKey,
+                                                    std::size_t thePoints);
+
+// File descriptor based access used for shared memory segments and cache files.
+// Reading returns empty pointers on failure, writing sizes the file and returns false on failure.
+std::shared_ptr<Fmi::CoordinateMatrix> readCoordinates(int theFd,
+                                                       std::size_t theKey,
+                                                       std::size_t theWidth,
+                                                       std::size_t theHeight);
+std::shared_ptr<std::vector<NFmiPoint>> readLatLons(int theFd,
+                                                    std::size_t theKey,
+                                                    std::size_t thePoints);
+
+// Check the header only without copying the data
+bool valid(int theFd, Kind theKind, std::size_t theKey);
+
+bool write(int theFd, Kind theKind, std::size_t theKey, const Fmi::CoordinateMatrix& theData);
+bool write(int theFd, Kind theKind, std::size_t theKey, const std::vector<NFmiPoint>& theData);
+
+}  // namespace CoordinateBlob
+}  // namespace Querydata
+}  // namespace Engine
+}  // namespace SmartMet
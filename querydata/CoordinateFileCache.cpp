@@ -0,0 +1,318 @@
+#include "CoordinateFileCache.h"
+#include "CoordinateBlob.h"
+#include <boost/functional/hash.hpp>
+#include <fmt/format.h>
+#include <gdal_version.h>
+#include <macgyver/Exception.h>
+#include <ogr_srs_api.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <ctime>
+#include <fcntl.h>
+#include <filesystem>
+#include <mutex>
+#include <unistd.h>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Querydata
+{
+namespace CoordinateFileCache
+{
+namespace
+{
+std::atomic<bool> g_Enabled{false};
+std::string g_Directory;
+std::string g_Stamp;
+std::size_t g_MaxBytes = 0;
+std::atomic<unsigned long> g_Counter{0};
+std::mutex g_SaveMutex;
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Identify the build which calculated the data
+ *
+ * The coordinates depend on the projection libraries as well as on this
+ * engine, hence files written by other builds or with other GDAL or PROJ
+ * versions are not used even if the blob format is the same.
+ */
+// ----------------------------------------------------------------------
+
+std::string build_stamp()
+{
+  int major = 0;
+  int minor = 0;
+  int patch = 0;
+  OSRGetPROJVersion(&major, &minor, &patch);
+
+  std::size_t hash = 0;
+  boost::hash_combine(hash, std::string(__DATE__ " " __TIME__));
+  boost::hash_combine(hash, std::string(GDAL_RELEASE_NAME));
+  boost::hash_combine(hash, major);
+  boost::hash_combine(hash, minor);
+  boost::hash_combine(hash, patch);
+
+  return fmt::format("v{}-{:08x}", CoordinateBlob::version(), hash & 0xffffffffUL);
+}
+
+std::string file_name(CoordinateBlob::Kind theKind, std::size_t theHash)
+{
+  const char* type = (theKind == CoordinateBlob::Kind::LatLons ? "ll" : "xy");
+  return fmt::format("{}/{}-{}-{:016x}.coords", g_Directory, type, g_Stamp, theHash);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Remove the least recently used files to make room
+ *
+ * Files are touched when read, hence the modification time tells when
+ * they were last used. Returns false if the new file cannot fit at all.
+ */
+// ----------------------------------------------------------------------
+
+bool make_room(std::size_t theBytes)
+{
+  if (g_MaxBytes == 0)
+    return true;
+  if (theBytes > g_MaxBytes)
+    return false;
+
+  struct File
+  {
+    std::time_t used;
+    std::size_t bytes;
+    std::string name;
+  };
+
+  std::vector<File> files;
+  std::size_t total = 0;
+
+  std::error_code ec;
+  for (const auto& entry : std::filesystem::directory_iterator(g_Directory, ec))
+  {
+    const auto& path = entry.path();
+    if (path.extension() != ".coords")
+      continue;
+
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+      continue;
+
+    const auto bytes = static_cast<std::size_t>(st.st_size);
+    files.push_back(File{st.st_mtime, bytes, path.string()});
+    total += bytes;
+  }
+
+  std::sort(
+      files.begin(), files.end(), [](const File& a, const File& b) { return a.used < b.used; });
+
+  for (const auto& file : files)
+  {
+    if (total + theBytes <= g_MaxBytes)
+      break;
+    if (unlink(file.name.c_str()) == 0)
+      total -= file.bytes;
+  }
+
+  return total + theBytes <= g_MaxBytes;
+}
+
+// Read a cached file. Files are renamed into place only when complete, hence a file
+// which fails validation is corrupt and is removed so that it can be written again.
+template <typename Reader>
+auto find(CoordinateBlob::Kind theKind, std::size_t theHash, Reader theReader)
+    -> decltype(theReader(0, 0))
+{
+  if (!g_Enabled)
+    return {};
+
+  const auto name = file_name(theKind, theHash);
+  int fd = open(name.c_str(), O_RDONLY);
+  if (fd < 0)
+    return {};
+
+  try
+  {
+    auto ret = theReader(fd, theHash);
+    if (ret)
+      futimens(fd, nullptr);  // mark as recently used
+    close(fd);
+    if (!ret)
+      unlink(name.c_str());
+    return ret;
+  }
+  catch (...)
+  {
+    close(fd);
+    throw;
+  }
+}
+
+std::size_t points(const Fmi::CoordinateMatrix& theData)
+{
+  return theData.width() * theData.height();
+}
+
+std::size_t points(const std::vector<NFmiPoint>& theData)
+{
+  return theData.size();
+}
+
+// Write to a temporary file and rename it so that readers see only complete files
+template <typename Data>
+void save(CoordinateBlob::Kind theKind, std::size_t theHash, const Data& theData)
+{
+  if (!g_Enabled)
+    return;
+
+  const auto name = file_name(theKind, theHash);
+  if (access(name.c_str(), F_OK) == 0)
+    return;
+
+  {
+    // Serialize the space accounting within the process
+    std::lock_guard<std::mutex> lock(g_SaveMutex);
+    if (!make_room(CoordinateBlob::size(points(theData))))
+      return;
+  }
+
+  const auto tmpname = fmt::format("{}.{}.{}.tmp", name, getpid(), ++g_Counter);
+  int fd = open(tmpname.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0)
+    return;
+
+  try
+  {
+    // Make sure the data is on disk before it becomes visible under the final name
+    const bool ok = (CoordinateBlob::write(fd, theKind, theHash, theData) && fsync(fd) == 0);
+    close(fd);
+    if (!ok || rename(tmpname.c_str(), name.c_str()) != 0)
+      unlink(tmpname.c_str());
+  }
+  catch (...)
+  {
+    close(fd);
+    unlink(tmpname.c_str());
+    throw;
+  }
+}
+
+}  // namespace
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Enable the cache
+ *
+ * Must be called before any other thread uses the cache. The directory
+ * is created if necessary, and leftover temporary files and files of
+ * other format versions or builds are removed. Zero size means no limit.
+ */
+// ----------------------------------------------------------------------
+
+void SetDirectory(const std::string& theDirectory, std::size_t theMaxBytes)
+{
+  try
+  {
+    if (theDirectory.empty())
+      return;
+
+    std::filesystem::create_directories(theDirectory);
+
+    g_Stamp = build_stamp();
+    const auto current = "-" + g_Stamp + "-";
+
+    for (const auto& entry : std::filesystem::directory_iterator(theDirectory))
+    {
+      if (!entry.is_regular_file())
+        continue;
+      const auto& path = entry.path();
+      if (path.extension() == ".tmp" ||
+          (path.extension() == ".coords" &&
+           path.filename().string().find(current) == std::string::npos))
+      {
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+      }
+    }
+
+    g_Directory = theDirectory;
+    g_MaxBytes = theMaxBytes;
+    g_Enabled = true;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Failed to set up coordinate cache directory")
+        .addParameter("directory", theDirectory);
+  }
+}
+
+bool Enabled()
+{
+  return g_Enabled;
+}
+
+std::shared_ptr<Fmi::CoordinateMatrix> FindCoordinates(std::size_t theHash,
+                                                       std::size_t theWidth,
+                                                       std::size_t theHeight)
+{
+  try
+  {
+    return find(CoordinateBlob::Kind::Coordinates,
+                theHash,
+                [theWidth, theHeight](int fd, std::size_t key)
+                { return CoordinateBlob::readCoordinates(fd, key, theWidth, theHeight); });
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+void SaveCoordinates(std::size_t theHash, const Fmi::CoordinateMatrix& theCoordinates)
+{
+  try
+  {
+    save(CoordinateBlob::Kind::Coordinates, theHash, theCoordinates);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+std::shared_ptr<std::vector<NFmiPoint>> FindLatLons(std::size_t theHash, std::size_t thePoints)
+{
+  try
+  {
+    return find(CoordinateBlob::Kind::LatLons,
+                theHash,
+                [thePoints](int fd, std::size_t key)
+                { return CoordinateBlob::readLatLons(fd, key, thePoints); });
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+void SaveLatLons(std::size_t theHash, const std::vector<NFmiPoint>& theLatLons)
+{
+  try
+  {
+    save(CoordinateBlob::Kind::LatLons, theHash, theLatLons);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+}  // namespace CoordinateFileCache
+}  // namespace Querydata
+}  // namespace Engine
+}  // namespace SmartMet
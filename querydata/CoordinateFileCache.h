@@ -0,0 +1,46 @@
+// ======================================================================
+/*!
+ * \brief Persistent cache of coordinate data in a local directory
+ *
+ * Latlon grids and projected coordinates are expensive to calculate
+ * for large grids, and would otherwise be recalculated after every
+ * restart. When a directory is configured, calculated data is stored
+ * there in the CoordinateBlob format in files named by the hash of the
+ * data, and read back with mmap on the next start. The least recently
+ * used files are removed when the size limit would be exceeded.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <gis/CoordinateMatrix.h>
+#include <newbase/NFmiPoint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Querydata
+{
+namespace CoordinateFileCache
+{
+// Disabled until a directory has been set
+void SetDirectory(const std::string& theDirectory, std::size_t theMaxBytes);
+bool Enabled();
+
+// The expected size is checked to guard against corrupt data and hash collisions
+std::shared_ptr<Fmi::CoordinateMatrix> FindCoordinates(std::size_t theHash,
+                                                       std::size_t theWidth,
+                                                       std::size_t theHeight);
+void SaveCoordinates(std::size_t theHash, const Fmi::CoordinateMatrix& theCoordinates);
+
+std::shared_ptr<std::vector<NFmiPoint>> FindLatLons(std::size_t theHash, std::size_t thePoints);
+void SaveLatLons(std::size_t theHash, const std::vector<NFmiPoint>& theLatLons);
+
+}  // namespace CoordinateFileCache
+}  // namespace Querydata
+}  // namespace Engine
+}  // namespace SmartMet
@@ -151,6 +151,40 @@ ValuesPtr Engine::getValuesForParam(const Q& /* theQ */,
   REPORT_DISABLED;
 }
 
+GridBufferPtr Engine::getValuesBufferDefault(const Q& /* theQ */,
+                                             const Spine::Parameter& /* theParam */,
+                                             std::size_t /* theValuesHash */,
+                                             const Fmi::DateTime& /* theTime */) const
+{
+  REPORT_DISABLED;
+}
+
+ValuesViewPtr Engine::getValuesViewDefault(const Q& /* theQ */,
+                                           const Spine::Parameter& /* theParam */,
+                                           const Fmi::DateTime& /* theTime */) const
+{
+  REPORT_DISABLED;
+}
+
+GridMaskPtr Engine::getGridMaskDefault(const Q& /* theQ */,
+                                       const OGRGeometry& /* theGeometry */) const
+{
+  REPORT_DISABLED;
+}
+
+Q Engine::getSampleDefault(const Q& /* theQ */,
+                           const Spine::Parameter& /* theParameter */,
+                           const Fmi::DateTime& /* theTime */,
+                           const Fmi::SpatialReference& /* theCrs */,
+                           double /* theXmin */,
+                           double /* theYmin */,
+                           double /* theXmax */,
+                           double /* theYmax */,
+                           double /* theResolution */) const
+{
+  REPORT_DISABLED;
+}
+
 void Engine::init() {}
 
 void Engine::shutdown() {}
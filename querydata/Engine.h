@@ -1,5 +1,6 @@
 #pragma once
 
+#include "GridMask.h"
 #include "OriginTime.h"
 #include "Producer.h"
 #include "RepoManager.h"
@@ -158,6 +159,52 @@ class Engine : public Spine::SmartMetEngine
     return getValuesForParam(theQ, theParam, theValuesHash, theTime);
   }
 
+  /**
+   *  @brief Contiguous time interpolated values with missing values as NaN
+   */
+  GridBufferPtr getValuesBuffer(const Q& theQ,
+                                const Spine::Parameter& theParam,
+                                std::size_t theValuesHash,
+                                const Fmi::DateTime& theTime) const
+  {
+    return getValuesBufferDefault(theQ, theParam, theValuesHash, theTime);
+  }
+
+  /**
+   *  @brief Zero-copy view to an exact timestep of the native grid, nullptr if not available
+   */
+  ValuesViewPtr getValuesView(const Q& theQ,
+                              const Spine::Parameter& theParam,
+                              const Fmi::DateTime& theTime) const
+  {
+    return getValuesViewDefault(theQ, theParam, theTime);
+  }
+
+  /**
+   *  @brief Grid points of the data inside a WGS84 geometry, cached by grid and geometry
+   */
+  GridMaskPtr getGridMask(const Q& theQ, const OGRGeometry& theGeometry) const
+  {
+    return getGridMaskDefault(theQ, theGeometry);
+  }
+
+  /**
+   *  @brief Cached QImpl::sample
+   */
+  Q getSample(const Q& theQ,
+              const Spine::Parameter& theParameter,
+              const Fmi::DateTime& theTime,
+              const Fmi::SpatialReference& theCrs,
+              double theXmin,
+              double theYmin,
+              double theXmax,
+              double theYmax,
+              double theResolution) const
+  {
+    return getSampleDefault(
+        theQ, theParameter, theTime, theCrs, theXmin, theYmin, theXmax, theYmax, theResolution);
+  }
+
  protected:
   virtual Repository::ContentTable getEngineContentsForAllProducers(
       const std::string& timeFormat, const std::string& projectionFormat) const;
@@ -186,6 +233,27 @@ class Engine : public Spine::SmartMetEngine
                                       std::size_t theValuesHash,
                                       const Fmi::DateTime& theTime) const;
 
+  virtual GridBufferPtr getValuesBufferDefault(const Q& theQ,
+                                               const Spine::Parameter& theParam,
+                                               std::size_t theValuesHash,
+                                               const Fmi::DateTime& theTime) const;
+
+  virtual ValuesViewPtr getValuesViewDefault(const Q& theQ,
+                                             const Spine::Parameter& theParam,
+                                             const Fmi::DateTime& theTime) const;
+
+  virtual GridMaskPtr getGridMaskDefault(const Q& theQ, const OGRGeometry& theGeometry) const;
+
+  virtual Q getSampleDefault(const Q& theQ,
+                             const Spine::Parameter& theParameter,
+                             const Fmi::DateTime& theTime,
+                             const Fmi::SpatialReference& theCrs,
+                             double theXmin,
+                             double theYmin,
+                             double theXmax,
+                             double theYmax,
+                             double theResolution) const;
+
   void init() override;
 
   void shutdown() override;
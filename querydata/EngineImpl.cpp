@@ -5,9 +5,12 @@
 // ======================================================================
 
 #include "EngineImpl.h"
+#include "AstronomyCache.h"
+#include "CoordinateFileCache.h"
 #include "MetaQueryFilters.h"
 #include "RepoManager.h"
 #include "Repository.h"
+#include "SharedMemoryRegistry.h"
 #include "WGS84EnvelopeFactory.h"
 #include <boost/thread.hpp>
 #include <gis/CoordinateTransformation.h>
@@ -42,6 +45,9 @@ namespace Querydata
 {
 namespace
 {
+// Default maximum size of resampled data in the cache
+const std::size_t default_sample_cache_size_mb = 1024;
+
 #if 0
 const auto badcoord = std::make_pair(std::numeric_limits<double>::quiet_NaN(),
                                      std::numeric_limits<double>::quiet_NaN());
@@ -149,55 +155,24 @@ CoordinatesPtr project_coordinates(const CoordinatesPtr& theCoords,
 
 // ----------------------------------------------------------------------
 /*!
- * \brief Change all kFloatMissing values to NaN
- */
-// ----------------------------------------------------------------------
-
-void set_missing_to_nan(NFmiDataMatrix<float>& values)
-{
-  const std::size_t nx = values.NX();
-  const std::size_t ny = values.NY();
-  if (nx == 0 || ny == 0)
-    return;
-
-  const auto nan = std::numeric_limits<float>::quiet_NaN();
-
-  // Unfortunately NFmiDataMatrix is a vector of vectors, memory
-  // access patterns are not optimal
-
-  for (std::size_t i = 0; i < nx; i++)
-  {
-    auto& tmp = values[i];
-    for (std::size_t j = 0; j < ny; j++)
-      if (tmp[j] == kFloatMissing)
-        tmp[j] = nan;
-  }
-}
-
-// ----------------------------------------------------------------------
-/*!
- * \brief Get data values and change kFloatMissing to NaN
+ * \brief Get data values with kFloatMissing changed to NaN
  */
 // ----------------------------------------------------------------------
 
 ValuesPtr get_values(const Q& theQ, const Fmi::DateTime& theTime)
 {
-  auto ret = std::make_shared<Values>(theQ->values(theTime));
-  set_missing_to_nan(*ret);
-  return ret;
+  return std::make_shared<Values>(theQ->nanValues(theTime));
 }
 
 // ----------------------------------------------------------------------
 /*!
- * \brief Get data values and change kFloatMissing to NaN
+ * \brief Get data values with kFloatMissing changed to NaN
  */
 // ----------------------------------------------------------------------
 
 ValuesPtr get_values(const Q& theQ, const Spine::Parameter& theParam, const Fmi::DateTime& theTime)
 {
-  auto ret = std::make_shared<Values>(theQ->values(theParam, theTime));
-  set_missing_to_nan(*ret);
-  return ret;
+  return std::make_shared<Values>(theQ->nanValues(theParam, theTime));
 }
 
 }  // namespace
@@ -211,6 +186,7 @@ ValuesPtr get_values(const Q& theQ, const Spine::Parameter& theParam, const Fmi:
 EngineImpl::EngineImpl(const std::string& configfile)
     : itsRepoManager(std::make_shared<RepoManager>(configfile)),
       itsConfigFile(configfile),
+      itsSampleCache(default_sample_cache_size_mb * 1024UL * 1024UL),
       itsParameterTranslations(std::make_shared<Spine::ParameterTranslations>()),
       lastConfigErrno(EINPROGRESS)
 {
@@ -239,11 +215,45 @@ void EngineImpl::init()
     // Init caches
     int coordinate_cache_size = 100;
     int values_cache_size = 5000;
+    int grid_buffer_cache_size = 5000;
+    int astronomy_cache_size = AstronomyCache::default_cache_size;
+    int grid_mask_cache_size = 1000;
+    int sample_cache_size_mb = default_sample_cache_size_mb;
+    int envelope_cache_size = 512;
     config.lookupValue("cache.coordinates_size", coordinate_cache_size);
     config.lookupValue("cache.values_size", values_cache_size);
+    config.lookupValue("cache.grid_buffers_size", grid_buffer_cache_size);
+    config.lookupValue("cache.astronomy_size", astronomy_cache_size);
+    config.lookupValue("cache.grid_masks_size", grid_mask_cache_size);
+    config.lookupValue("cache.samples_size_mb", sample_cache_size_mb);
+    config.lookupValue("cache.envelopes_size", envelope_cache_size);
 
     itsCoordinateCache.resize(coordinate_cache_size);
     itsValuesCache.resize(values_cache_size);
+    itsGridBufferCache.resize(grid_buffer_cache_size);
+    itsGridMaskCache.resize(grid_mask_cache_size);
+    itsSampleCache.resize(sample_cache_size_mb * 1024UL * 1024UL);
+    AstronomyCache::SetCacheSize(astronomy_cache_size);
+    WGS84EnvelopeFactory::SetCacheSize(envelope_cache_size);
+
+    // Share coordinates with other server processes on the same host
+    bool shared_memory_enabled = false;
+    std::string shared_memory_prefix = "/smartmet-qd";
+    int shared_memory_size_mb = 1024;
+    config.lookupValue("shared_memory.enabled", shared_memory_enabled);
+    config.lookupValue("shared_memory.prefix", shared_memory_prefix);
+    config.lookupValue("shared_memory.max_size_mb", shared_memory_size_mb);
+    if (shared_memory_enabled)
+      SharedMemoryRegistry::Enable(shared_memory_prefix,
+                                   std::max(0, shared_memory_size_mb) * 1024UL * 1024UL);
+
+    // Keep calculated coordinates over restarts
+    std::string coordinates_dir;
+    int coordinates_dir_size_mb = 4096;
+    config.lookupValue("cache.coordinates_dir", coordinates_dir);
+    config.lookupValue("cache.coordinates_dir_max_size_mb", coordinates_dir_size_mb);
+    CoordinateFileCache::SetDirectory(coordinates_dir,
+                                      std::max(0, coordinates_dir_size_mb) * 1024UL * 1024UL);
 
     // Init querydata manager
     auto repomanager = itsRepoManager.load();
@@ -298,6 +308,30 @@ void EngineImpl::init()
   }
 }
 
+// ----------------------------------------------------------------------
+/*!
+ * \brief Release cached samples whose source data has left the repository
+ */
+// ----------------------------------------------------------------------
+
+void EngineImpl::expireSamples() const
+{
+  try
+  {
+    auto repomanager = itsRepoManager.load();
+    itsSampleCache.expire(
+        [&repomanager](const SharedModel& model)
+        {
+          Spine::ReadLock lock(repomanager->itsMutex);
+          return repomanager->itsRepo.getModel(model->producer(), model->path()) == model;
+        });
+  }
+  catch (...)
+  {
+    Fmi::Exception::Trace(BCP, "Failed to expire cached samples").printError();
+  }
+}
+
 // ----------------------------------------------------------------------
 /*!
  * \brief Watch the config file to change
@@ -313,6 +347,8 @@ void EngineImpl::configFileWatch()
   {
     boost::this_thread::sleep_for(boost::chrono::seconds(1));
 
+    expireSamples();
+
     // If file was deleted, skip and go waiting until it is back
     if (!std::filesystem::exists(itsConfigFile, ec))
     {
@@ -888,7 +924,29 @@ CoordinatesPtr EngineImpl::getWorldCoordinatesForSR(const Q& theQ,
     // be included in all stages of the projection, and large errors will occur if the datums
     // differ significantly (e.g. sphere vs ellipsoid)
 
-    auto ftr2 = std::async([&] { return project_coordinates(worldxy, theQ, theSR); }).share();
+    auto ftr2 = std::async(
+                    [&]
+                    {
+                      // Another process on the host may already have done the work
+                      auto coords = SharedMemoryRegistry::FindCoordinates(
+                          projhash, worldxy->width(), worldxy->height());
+                      if (coords)
+                        return coords;
+
+                      // Or an earlier run
+                      coords = CoordinateFileCache::FindCoordinates(
+                          projhash, worldxy->width(), worldxy->height());
+                      if (!coords)
+                      {
+                        coords = project_coordinates(worldxy, theQ, theSR);
+                        if (coords)
+                          CoordinateFileCache::SaveCoordinates(projhash, *coords);
+                      }
+                      if (coords)
+                        SharedMemoryRegistry::PublishCoordinates(projhash, *coords);
+                      return coords;
+                    })
+                    .share();
 
     itsCoordinateCache.insert(projhash, ftr2);
     return ftr2.get();
@@ -982,6 +1040,145 @@ ValuesPtr EngineImpl::getValuesForParam(const Q& theQ,
   }
 }
 
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get the data values as a contiguous buffer
+ *
+ * Cached the same way as the matrices returned by getValues.
+ */
+// ----------------------------------------------------------------------
+
+GridBufferPtr EngineImpl::getValuesBufferDefault(const Q& theQ,
+                                                 const Spine::Parameter& theParam,
+                                                 std::size_t theValuesHash,
+                                                 const Fmi::DateTime& theTime) const
+{
+  try
+  {
+    auto values = itsGridBufferCache.find(theValuesHash);
+    if (values)
+      return values->get();
+
+    auto ftr = std::async(std::launch::async,
+                          [&]()
+                          {
+                            return std::make_shared<GridBuffer>(
+                                theQ->valuesBuffer(theParam, theTime, true));
+                          })
+                   .share();
+
+    itsGridBufferCache.insert(theValuesHash, ftr);
+
+    return ftr.get();
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Failed to retrieve data")
+        .addParameter("time", Fmi::to_iso_extended_string(theTime));
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get a view to the data values without copying them
+ *
+ * Views are not cached, since creating one costs next to nothing.
+ */
+// ----------------------------------------------------------------------
+
+ValuesViewPtr EngineImpl::getValuesViewDefault(const Q& theQ,
+                                               const Spine::Parameter& theParam,
+                                               const Fmi::DateTime& theTime) const
+{
+  try
+  {
+    return theQ->valuesView(theParam, theTime);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Failed to retrieve data")
+        .addParameter("time", Fmi::to_iso_extended_string(theTime));
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get the grid points inside a geometry
+ *
+ * The mask depends only on the grid and the geometry, hence it is
+ * shared by all models with the same grid.
+ */
+// ----------------------------------------------------------------------
+
+GridMaskPtr EngineImpl::getGridMaskDefault(const Q& theQ, const OGRGeometry& theGeometry) const
+{
+  try
+  {
+    auto hash = theQ->gridHashValue();
+    Fmi::hash_combine(hash, GridMask::hashValue(theGeometry));
+
+    auto mask = itsGridMaskCache.find(hash);
+    if (mask)
+      return mask->get();
+
+    auto ftr = std::async(std::launch::async,
+                          [&]() -> GridMaskPtr { return GridMask::create(theQ, theGeometry); })
+                   .share();
+
+    itsGridMaskCache.insert(hash, ftr);
+    return ftr.get();
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Failed to create grid mask");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Resample data using a cache
+ *
+ * Identical requests, for example from different map tiles, share the
+ * same sampled data. Concurrent requests wait for the first one.
+ */
+// ----------------------------------------------------------------------
+
+Q EngineImpl::getSampleDefault(const Q& theQ,
+                               const Spine::Parameter& theParameter,
+                               const Fmi::DateTime& theTime,
+                               const Fmi::SpatialReference& theCrs,
+                               double theXmin,
+                               double theYmin,
+                               double theXmax,
+                               double theYmax,
+                               double theResolution) const
+{
+  try
+  {
+    auto hash = theQ->sampleHash(
+        theParameter, theTime, theCrs, theXmin, theYmin, theXmax, theYmax, theResolution);
+
+    return itsSampleCache.get(hash,
+                              theQ,
+                              [&]()
+                              {
+                                return theQ->sample(theParameter,
+                                                    theTime,
+                                                    theCrs,
+                                                    theXmin,
+                                                    theYmin,
+                                                    theXmax,
+                                                    theYmax,
+                                                    theResolution);
+                              });
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Failed to sample data")
+        .addParameter("time", Fmi::to_iso_extended_string(theTime));
+  }
+}
+
 std::time_t EngineImpl::getConfigModTime()
 {
   auto repomanager = itsRepoManager.load();
@@ -1001,7 +1198,12 @@ Fmi::Cache::CacheStatistics EngineImpl::getCacheStats() const
   ret["Querydata::lat_lon_cache"] = repomanager->getCacheStats();
   ret["Querydata::wgs84_envelope_cache"] = WGS84EnvelopeFactory::getCacheStats();
   ret["Querydata::values_cache"] = itsValuesCache.statistics();
+  ret["Querydata::grid_buffer_cache"] = itsGridBufferCache.statistics();
   ret["Querydata::coordinate_cache"] = itsCoordinateCache.statistics();
+  ret["Querydata::grid_mask_cache"] = itsGridMaskCache.statistics();
+  ret["Querydata::sample_cache"] = itsSampleCache.statistics();
+  ret["Querydata::solar_time_cache"] = AstronomyCache::getSolarCacheStats();
+  ret["Querydata::lunar_time_cache"] = AstronomyCache::getLunarCacheStats();
   return ret;
 }
 
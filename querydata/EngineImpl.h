@@ -9,6 +9,7 @@
 #include "Engine.h"
 #include "Producer.h"
 #include "Repository.h"
+#include "SampleCache.h"
 #include <boost/atomic.hpp>
 #include <boost/smart_ptr/atomic_shared_ptr.hpp>
 #include <gis/CoordinateMatrix.h>
@@ -64,6 +65,17 @@ class EngineImpl final : public Engine
   using ValuesCache = Fmi::Cache::Cache<std::size_t, std::shared_future<ValuesPtr>>;
   mutable ValuesCache itsValuesCache;
 
+  // Cached querydata values in contiguous buffers
+  using GridBufferCache = Fmi::Cache::Cache<std::size_t, std::shared_future<GridBufferPtr>>;
+  mutable GridBufferCache itsGridBufferCache;
+
+  // Cached geometry masks
+  using GridMaskCache = Fmi::Cache::Cache<std::size_t, std::shared_future<GridMaskPtr>>;
+  mutable GridMaskCache itsGridMaskCache;
+
+  // Cached resampled data
+  mutable SampleCache itsSampleCache;
+
   Fmi::AtomicSharedPtr<Spine::ParameterTranslations> itsParameterTranslations;
 
  protected:
@@ -154,6 +166,27 @@ class EngineImpl final : public Engine
                               std::size_t theValuesHash,
                               const Fmi::DateTime& theTime) const override;
 
+  GridBufferPtr getValuesBufferDefault(const Q& theQ,
+                                       const Spine::Parameter& theParam,
+                                       std::size_t theValuesHash,
+                                       const Fmi::DateTime& theTime) const override;
+
+  ValuesViewPtr getValuesViewDefault(const Q& theQ,
+                                     const Spine::Parameter& theParam,
+                                     const Fmi::DateTime& theTime) const override;
+
+  GridMaskPtr getGridMaskDefault(const Q& theQ, const OGRGeometry& theGeometry) const override;
+
+  Q getSampleDefault(const Q& theQ,
+                     const Spine::Parameter& theParameter,
+                     const Fmi::DateTime& theTime,
+                     const Fmi::SpatialReference& theCrs,
+                     double theXmin,
+                     double theYmin,
+                     double theXmax,
+                     double theYmax,
+                     double theResolution) const override;
+
   void init() override;
   void shutdown() override;
   std::time_t getConfigModTime();
@@ -163,6 +196,7 @@ class EngineImpl final : public Engine
  private:
   boost::thread configFileWatcher;  // A thread watching for config file changes
   void configFileWatch();           // A function in separate thread checking the config file
+  void expireSamples() const;       // Release samples of data no longer in the repository
   Fmi::Cache::CacheStatistics getCacheStats() const override;  // Get cache statistics
 
   std::unique_ptr<SmartMet::Spine::Table> requestQEngineStatus(
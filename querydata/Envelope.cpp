@@ -1,5 +1,11 @@
 #include "Envelope.h"
+#include <macgyver/Exception.h>
+#include <newbase/NFmiArea.h>
 #include <newbase/NFmiFastQueryInfo.h>
+#include <newbase/NFmiGrid.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
 
 namespace SmartMet
 {
@@ -7,6 +13,53 @@ namespace Engine
 {
 namespace Querydata
 {
+namespace
+{
+// Number of segments used to trace each edge of the grid before refining them
+const unsigned int border_steps = 100;
+
+// Maximum deviation in degrees of a curved edge segment from a straight line
+const double straightness_tolerance = 1e-4;
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Trace a grid edge segment between two grid coordinates
+ *
+ * The segment is split at its midpoint as long as the midpoint deviates
+ * from the straight line between the end points, but not beyond the
+ * grid resolution. Tracing the edge point by point would give no more
+ * extremes than that.
+ */
+// ----------------------------------------------------------------------
+
+template <typename Add>
+void trace_edge(const NFmiGrid& theGrid,
+                const NFmiPoint& theGrid1,
+                const NFmiPoint& theLatLon1,
+                const NFmiPoint& theGrid2,
+                const NFmiPoint& theLatLon2,
+                const Add& theAdd)
+{
+  if (std::abs(theGrid2.X() - theGrid1.X()) + std::abs(theGrid2.Y() - theGrid1.Y()) <= 1)
+    return;
+
+  const NFmiPoint grid(0.5 * (theGrid1.X() + theGrid2.X()), 0.5 * (theGrid1.Y() + theGrid2.Y()));
+  const NFmiPoint latlon = theGrid.GridToLatLon(grid.X(), grid.Y());
+  theAdd(latlon);
+
+  const bool straight =
+      (std::abs(latlon.X() - 0.5 * (theLatLon1.X() + theLatLon2.X())) <= straightness_tolerance &&
+       std::abs(latlon.Y() - 0.5 * (theLatLon1.Y() + theLatLon2.Y())) <= straightness_tolerance);
+
+  if (straight || !std::isfinite(latlon.X()) || !std::isfinite(latlon.Y()))
+    return;
+
+  trace_edge(theGrid, theGrid1, theLatLon1, grid, latlon, theAdd);
+  trace_edge(theGrid, grid, latlon, theGrid2, theLatLon2, theAdd);
+}
+
+}  // namespace
+
 WGS84Envelope::WGS84Envelope() : mRangeLon(-180.0, 180.0), mRangeLat(-90.0, 90.0) {}
 
 WGS84Envelope::WGS84Envelope(const WGS84Envelope& other)
@@ -17,58 +70,133 @@ WGS84Envelope::WGS84Envelope(const WGS84Envelope& other)
 WGS84Envelope::WGS84Envelope(const std::shared_ptr<NFmiFastQueryInfo>& info)
     : mRangeLon(-180.0, 180.0), mRangeLat(-90.0, 90.0)
 {
-  // Calculate latlon boundary
-  info->FirstParam();
+  try
+  {
+    if (info->Area() != nullptr && info->Grid() != nullptr)
+      calculateGridEnvelope(*info);
+    else
+      calculatePointEnvelope(*info);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Calculate the envelope of gridded data
+ *
+ * The grid border is first traced with a fixed number of fractional
+ * grid coordinates per edge, and the segments are then densified where
+ * the edge curves, at most down to the grid resolution. Hence straight
+ * edges cost little, and curved edges cannot hide extremes between the
+ * traced points. If a pole is inside the area the latitude range is
+ * extended to it and all longitudes are covered.
+ */
+// ----------------------------------------------------------------------
+
+void WGS84Envelope::calculateGridEnvelope(const NFmiFastQueryInfo& info)
+{
+  const auto* grid = info.Grid();
+  const auto* area = info.Area();
+
+  const double nx = grid->XNumber();
+  const double ny = grid->YNumber();
 
-  // TODO: This algorithm is bugged, it will not work for arctic data where the pole is in the
-  // middle of the data
-  if (info->Area() != nullptr)
+  double minlon = std::numeric_limits<double>::infinity();
+  double maxlon = -minlon;
+  double minlat = minlon;
+  double maxlat = -minlon;
+
+  auto add = [&](const NFmiPoint& p)
+  {
+    if (!std::isfinite(p.X()) || !std::isfinite(p.Y()))
+      return;
+    minlon = std::min(minlon, p.X());
+    maxlon = std::max(maxlon, p.X());
+    minlat = std::min(minlat, p.Y());
+    maxlat = std::max(maxlat, p.Y());
+  };
+
+  // Trace an edge from one grid corner to another
+  auto edge = [&](const NFmiPoint& theStart, const NFmiPoint& theEnd, unsigned int theSteps)
   {
-    // Gridded data
-    const NFmiPoint& point = info->LatLon(0);
-    mRangeLon.set(point.X(), point.X());
-    mRangeLat.set(point.Y(), point.Y());
-    const auto nX = info->GridXNumber();
-    const auto nY = info->GridYNumber();
-    for (std::size_t yId = 0; yId < nY; yId++)
+    NFmiPoint g1 = theStart;
+    NFmiPoint p1 = grid->GridToLatLon(g1.X(), g1.Y());
+    add(p1);
+    for (unsigned int k = 1; k <= theSteps; k++)
     {
-      auto baseId = yId * nX;
-      for (std::size_t id = baseId; id < baseId + nX; id++)
-      {
-        const NFmiPoint& p = info->LatLon(id);
-        mRangeLon.set(std::min(mRangeLon.getMin(), p.X()), std::max(mRangeLon.getMax(), p.X()));
-        mRangeLat.set(std::min(mRangeLat.getMin(), p.Y()), std::max(mRangeLat.getMax(), p.Y()));
-        // Only the first and the last index in the lines [1,nY-1]
-        if (id == baseId and yId != 0 and yId != nY - 1)
-          id += nX - 2;
-      }
+      const double t = static_cast<double>(k) / theSteps;
+      const NFmiPoint g2(theStart.X() + t * (theEnd.X() - theStart.X()),
+                         theStart.Y() + t * (theEnd.Y() - theStart.Y()));
+      const NFmiPoint p2 = grid->GridToLatLon(g2.X(), g2.Y());
+      add(p2);
+      trace_edge(*grid, g1, p1, g2, p2, add);
+      g1 = g2;
+      p1 = p2;
     }
+  };
+
+  const auto xsteps = std::max(1U, std::min(border_steps, static_cast<unsigned int>(nx - 1)));
+  const auto ysteps = std::max(1U, std::min(border_steps, static_cast<unsigned int>(ny - 1)));
+
+  edge(NFmiPoint(0, 0), NFmiPoint(nx - 1, 0), xsteps);
+  edge(NFmiPoint(0, ny - 1), NFmiPoint(nx - 1, ny - 1), xsteps);
+  edge(NFmiPoint(0, 0), NFmiPoint(0, ny - 1), ysteps);
+  edge(NFmiPoint(nx - 1, 0), NFmiPoint(nx - 1, ny - 1), ysteps);
+
+  // Should not happen, but keep the global default if it does
+  if (!std::isfinite(minlon) || !std::isfinite(minlat))
+    return;
+
+  if (area->IsInside(NFmiPoint(0, 90)))
+  {
+    maxlat = 90;
+    minlon = -180;
+    maxlon = 180;
   }
-  else
+  if (area->IsInside(NFmiPoint(0, -90)))
   {
-    // Point data
-    bool first = true;
-    for (info->ResetLocation(); info->NextLocation();)
-    {
-      NFmiPoint point = info->LatLon();
-      if (point.X() != kFloatMissing && point.Y() != kFloatMissing)
-      {
-        if (first)
-        {
-          mRangeLon.set(point.X(), point.X());
-          mRangeLat.set(point.Y(), point.Y());
-          first = false;
-        }
-        else
-        {
-          mRangeLon.set(std::min(mRangeLon.getMin(), point.X()),
-                        std::max(mRangeLon.getMax(), point.X()));
-          mRangeLat.set(std::min(mRangeLat.getMin(), point.Y()),
-                        std::max(mRangeLat.getMax(), point.Y()));
-        }
-      }
-    }
+    minlat = -90;
+    minlon = -180;
+    maxlon = 180;
   }
+
+  mRangeLon.set(minlon, maxlon);
+  mRangeLat.set(minlat, maxlat);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Calculate the envelope of point data
+ */
+// ----------------------------------------------------------------------
+
+void WGS84Envelope::calculatePointEnvelope(const NFmiFastQueryInfo& info)
+{
+  double minlon = std::numeric_limits<double>::infinity();
+  double maxlon = -minlon;
+  double minlat = minlon;
+  double maxlat = -minlon;
+
+  const auto n = info.SizeLocations();
+  for (unsigned long i = 0; i < n; i++)
+  {
+    const NFmiPoint p = info.LatLon(i);
+    if (p.X() == kFloatMissing || p.Y() == kFloatMissing)
+      continue;
+    minlon = std::min(minlon, p.X());
+    maxlon = std::max(maxlon, p.X());
+    minlat = std::min(minlat, p.Y());
+    maxlat = std::max(maxlat, p.Y());
+  }
+
+  if (!std::isfinite(minlon))
+    return;
+
+  mRangeLon.set(minlon, maxlon);
+  mRangeLat.set(minlat, maxlat);
 }
 
 WGS84Envelope& WGS84Envelope::operator=(const WGS84Envelope& other)
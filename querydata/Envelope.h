@@ -32,6 +32,9 @@ class WGS84Envelope
   const RangeLat& getRangeLat() const;
 
  private:
+  void calculateGridEnvelope(const NFmiFastQueryInfo& info);
+  void calculatePointEnvelope(const NFmiFastQueryInfo& info);
+
   RangeLon mRangeLon;
   RangeLat mRangeLat;
 };
@@ -0,0 +1,84 @@
+#include "GridBuffer.h"
+#include <macgyver/Exception.h>
+#include <algorithm>
+#include <limits>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Querydata
+{
+GridBuffer::GridBuffer(std::size_t theWidth, std::size_t theHeight, float theValue)
+    : itsWidth(theWidth), itsHeight(theHeight), itsValues(theWidth * theHeight, theValue)
+{
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Copy a column-major matrix into a buffer
+ */
+// ----------------------------------------------------------------------
+
+GridBuffer GridBuffer::fromMatrix(const NFmiDataMatrix<float>& theMatrix)
+{
+  try
+  {
+    const std::size_t nx = theMatrix.NX();
+    const std::size_t ny = theMatrix.NY();
+
+    GridBuffer ret(nx, ny);
+    for (std::size_t i = 0; i < nx; i++)
+    {
+      const auto& column = theMatrix[i];
+      for (std::size_t j = 0; j < ny; j++)
+        ret.itsValues[j * nx + i] = column[j];
+    }
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Copy the buffer into a column-major matrix
+ */
+// ----------------------------------------------------------------------
+
+NFmiDataMatrix<float> GridBuffer::toMatrix() const
+{
+  try
+  {
+    NFmiDataMatrix<float> ret(itsWidth, itsHeight);
+    for (std::size_t i = 0; i < itsWidth; i++)
+    {
+      auto& column = ret[i];
+      for (std::size_t j = 0; j < itsHeight; j++)
+        column[j] = itsValues[j * itsWidth + i];
+    }
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Change all kFloatMissing values to NaN
+ */
+// ----------------------------------------------------------------------
+
+void GridBuffer::setMissingToNaN()
+{
+  std::replace(
+      itsValues.begin(), itsValues.end(), kFloatMissing, std::numeric_limits<float>::quiet_NaN());
+}
+
+}  // namespace Querydata
+}  // namespace Engine
+}  // namespace SmartMet
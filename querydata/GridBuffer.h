@@ -0,0 +1,116 @@
+// ======================================================================
+/*!
+ * \brief Contiguous row-major grid of values
+ *
+ * An alternative to NFmiDataMatrix<float>, which stores each column as
+ * a separate vector. The values are stored in a single allocation
+ * aligned for SIMD processing, with the location index j*NX()+i
+ * matching the order of the querydata grid points.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <newbase/NFmiDataMatrix.h>
+#include <newbase/NFmiGlobals.h>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Querydata
+{
+// Allocator for SIMD friendly alignment
+template <typename T, std::size_t Alignment = 64>
+class AlignedAllocator
+{
+ public:
+  using value_type = T;
+
+  template <typename U>
+  struct rebind
+  {
+    using other = AlignedAllocator<U, Alignment>;
+  };
+
+  AlignedAllocator() = default;
+
+  template <typename U>
+  AlignedAllocator(const AlignedAllocator<U, Alignment>& /* other */)
+  {
+  }
+
+  T* allocate(std::size_t n)
+  {
+    if (n == 0)
+      return nullptr;
+    // aligned_alloc requires the size to be a multiple of the alignment
+    const std::size_t bytes = ((n * sizeof(T) + Alignment - 1) / Alignment) * Alignment;
+    void* ptr = std::aligned_alloc(Alignment, bytes);
+    if (ptr == nullptr)
+      throw std::bad_alloc();
+    return static_cast<T*>(ptr);
+  }
+
+  void deallocate(T* ptr, std::size_t /* n */) { std::free(ptr); }
+
+  template <typename U>
+  bool operator==(const AlignedAllocator<U, Alignment>& /* other */) const
+  {
+    return true;
+  }
+
+  template <typename U>
+  bool operator!=(const AlignedAllocator<U, Alignment>& /* other */) const
+  {
+    return false;
+  }
+};
+
+class GridBuffer
+{
+ public:
+  using Storage = std::vector<float, AlignedAllocator<float>>;
+
+  GridBuffer() = default;
+  GridBuffer(std::size_t theWidth, std::size_t theHeight, float theValue = kFloatMissing);
+
+  // Adapters for the legacy matrix type. These must copy, since the
+  // memory layouts differ.
+  static GridBuffer fromMatrix(const NFmiDataMatrix<float>& theMatrix);
+  NFmiDataMatrix<float> toMatrix() const;
+
+  std::size_t NX() const { return itsWidth; }
+  std::size_t NY() const { return itsHeight; }
+  std::size_t size() const { return itsValues.size(); }
+  bool empty() const { return itsValues.empty(); }
+
+  float* data() { return itsValues.data(); }
+  const float* data() const { return itsValues.data(); }
+
+  float* row(std::size_t j) { return itsValues.data() + j * itsWidth; }
+  const float* row(std::size_t j) const { return itsValues.data() + j * itsWidth; }
+
+  float& operator[](std::size_t theIndex) { return itsValues[theIndex]; }
+  float operator[](std::size_t theIndex) const { return itsValues[theIndex]; }
+
+  float& operator()(std::size_t i, std::size_t j) { return itsValues[j * itsWidth + i]; }
+  float operator()(std::size_t i, std::size_t j) const { return itsValues[j * itsWidth + i]; }
+
+  void setMissingToNaN();
+
+ private:
+  std::size_t itsWidth = 0;
+  std::size_t itsHeight = 0;
+  Storage itsValues;
+};
+
+using GridBufferPtr = std::shared_ptr<GridBuffer>;
+
+}  // namespace Querydata
+}  // namespace Engine
+}  // namespace SmartMet
@@ -0,0 +1,152 @@
+#include "GridMask.h"
+#include <macgyver/Exception.h>
+#include <macgyver/Hash.h>
+#include <newbase/NFmiGeoTools.h>
+#include <newbase/NFmiGrid.h>
+#include <ogr_geometry.h>
+#include <string>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Querydata
+{
+namespace
+{
+// Distance in meters between two grid points
+double distance(const Q& theQ, long theIndex1, long theIndex2)
+{
+  const auto p1 = theQ->latLon(theIndex1);
+  const auto p2 = theQ->latLon(theIndex2);
+  return NFmiGeoTools::GeoDistance(p1.X(), p1.Y(), p2.X(), p2.Y());
+}
+
+// Grid spacing in meters at the given position along one axis
+double spacing(const Q& theQ, long theIndex, long thePos, long theSize, long theStride)
+{
+  if (theSize < 2)
+    return 0;
+  if (thePos == 0)
+    return distance(theQ, theIndex, theIndex + theStride);
+  if (thePos == theSize - 1)
+    return distance(theQ, theIndex - theStride, theIndex);
+  return distance(theQ, theIndex - theStride, theIndex + theStride) / 2;
+}
+
+}  // namespace
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Hash value of a geometry based on its WKB representation
+ */
+// ----------------------------------------------------------------------
+
+std::size_t GridMask::hashValue(const OGRGeometry& theGeometry)
+{
+  try
+  {
+    std::string wkb(theGeometry.WkbSize(), '\0');
+    theGeometry.exportToWkb(wkbNDR, reinterpret_cast<unsigned char*>(wkb.data()));
+    return Fmi::hash_value(wkb);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Rasterize the geometry onto the grid of the data
+ *
+ * A grid point belongs to the mask if it intersects the geometry.
+ */
+// ----------------------------------------------------------------------
+
+std::shared_ptr<GridMask> GridMask::create(const Q& theQ, const OGRGeometry& theGeometry)
+{
+  try
+  {
+    if (!theQ->isGrid())
+      throw Fmi::Exception(BCP, "Cannot create a grid mask for point data");
+
+    const auto& grid = theQ->grid();
+    const long nx = grid.XNumber();
+    const long ny = grid.YNumber();
+
+    OGREnvelope envelope;
+    theGeometry.getEnvelope(&envelope);
+
+    // Prepared geometries make repeated point tests much faster
+    OGRPreparedGeometryUniquePtr prepared(OGRCreatePreparedGeometry(&theGeometry));
+
+    auto mask = std::make_shared<GridMask>();
+    mask->itsGridHash = theQ->gridHashValue();
+
+    for (long j = 0; j < ny; j++)
+    {
+      for (long i = 0; i < nx; i++)
+      {
+        const long idx = j * nx + i;
+        const auto latlon = theQ->latLon(idx);
+
+        if (latlon.X() < envelope.MinX || latlon.X() > envelope.MaxX ||
+            latlon.Y() < envelope.MinY || latlon.Y() > envelope.MaxY)
+          continue;
+
+        OGRPoint point(latlon.X(), latlon.Y());
+        const bool inside = (prepared ? OGRPreparedGeometryIntersects(prepared.get(), &point)
+                                      : theGeometry.Intersects(&point));
+        if (!inside)
+          continue;
+
+        auto& runs = mask->itsRuns;
+        if (!runs.empty() && runs.back().start + runs.back().length == idx)
+          ++runs.back().length;
+        else
+          runs.push_back(Run{static_cast<std::uint32_t>(idx), 1});
+
+        const double dx = spacing(theQ, idx, i, nx, 1);
+        const double dy = spacing(theQ, idx, j, ny, nx);
+        const auto area = static_cast<float>(dx * dy / 1e6);
+        mask->itsWeights.push_back(area);
+        mask->itsTotalWeight += area;
+      }
+    }
+
+    mask->itsRuns.shrink_to_fit();
+    mask->itsWeights.shrink_to_fit();
+    return mask;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Expand the runs into an index mask
+ */
+// ----------------------------------------------------------------------
+
+NFmiIndexMask GridMask::indexMask() const
+{
+  try
+  {
+    NFmiIndexMask mask;
+    for (const auto& run : itsRuns)
+      for (std::uint32_t i = 0; i < run.length; i++)
+        mask.insert(run.start + i);
+    return mask;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+}  // namespace Querydata
+}  // namespace Engine
+}  // namespace SmartMet
@@ -0,0 +1,69 @@
+// ======================================================================
+/*!
+ * \brief A geometry rasterized onto a querydata grid
+ *
+ * The grid points inside the geometry are stored as runs of
+ * consecutive location indices along with the approximate area of
+ * each cell. The mask depends only on the geometry and the grid,
+ * hence it can be shared by all models on the same grid.
+ */
+// ======================================================================
+
+#pragma once
+
+#include "Q.h"
+#include <newbase/NFmiIndexMask.h>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class OGRGeometry;
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Querydata
+{
+class GridMask
+{
+ public:
+  struct Run
+  {
+    std::uint32_t start;   // first location index
+    std::uint32_t length;  // number of consecutive indices
+  };
+
+  // Geometry coordinates must be WGS84 longitudes and latitudes
+  static std::shared_ptr<GridMask> create(const Q& theQ, const OGRGeometry& theGeometry);
+
+  // Hash of the geometry for caching purposes
+  static std::size_t hashValue(const OGRGeometry& theGeometry);
+
+  // Hash of the grid the mask was rasterized for
+  std::size_t gridHash() const { return itsGridHash; }
+
+  const std::vector<Run>& runs() const { return itsRuns; }
+
+  // Cell areas in square kilometers, one per cell in run order
+  const std::vector<float>& weights() const { return itsWeights; }
+
+  std::size_t size() const { return itsWeights.size(); }
+  bool empty() const { return itsWeights.empty(); }
+  double totalWeight() const { return itsTotalWeight; }
+
+  // Expanded mask for the index mask based QImpl methods
+  NFmiIndexMask indexMask() const;
+
+ private:
+  std::size_t itsGridHash = 0;
+  std::vector<Run> itsRuns;
+  std::vector<float> itsWeights;
+  double itsTotalWeight = 0;
+};
+
+using GridMaskPtr = std::shared_ptr<const GridMask>;
+
+}  // namespace Querydata
+}  // namespace Engine
+}  // namespace SmartMet
@@ -0,0 +1,318 @@
+#include "InotifyMonitor.h"
+#include <boost/thread.hpp>
+#include <macgyver/AnsiEscapeCodes.h>
+#include <macgyver/Exception.h>
+#include <spine/Convenience.h>
+#include <spine/Reactor.h>
+#include <sys/inotify.h>
+#include <sys/vfs.h>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <poll.h>
+#include <unistd.h>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Querydata
+{
+namespace
+{
+// Timeout for checking stop requests
+const int poll_timeout_ms = 500;
+
+// Network file system types, see statfs(2)
+const std::array<long, 7> network_filesystems = {
+    0x6969L,      // NFS
+    0xFF534D42L,  // CIFS
+    0xFE534D42L,  // SMB2
+    0x517BL,      // SMB
+    0x65735546L,  // FUSE
+    0x00C36400L,  // CEPH
+    0x47504653L   // GPFS
+};
+
+// Completed writes, atomic renames into the directory, writes and removals, and
+// the removal or renaming of the directory itself
+const uint32_t watch_mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MODIFY | IN_DELETE | IN_MOVED_FROM |
+                            IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+// Events after which the watch no longer follows the directory
+const uint32_t lost_mask = IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF;
+
+void rescan(const InotifyMonitor::RescanCallback& theRescan, const Producer& theProducer)
+{
+  try
+  {
+    theRescan(theProducer);
+  }
+  catch (...)
+  {
+    Fmi::Exception::Trace(BCP, "Failed to rescan directory")
+        .addParameter("Producer", theProducer)
+        .printError();
+  }
+}
+
+}  // namespace
+
+InotifyMonitor::~InotifyMonitor()
+{
+  if (itsFd >= 0)
+    close(itsFd);
+}
+
+InotifyMonitor::InotifyMonitor() : itsFd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) {}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Test whether inotify can be trusted for the directory
+ */
+// ----------------------------------------------------------------------
+
+bool InotifyMonitor::supported(const std::filesystem::path& theDirectory)
+{
+  struct statfs info;
+  if (statfs(theDirectory.c_str(), &info) != 0)
+    return false;
+
+  for (auto type : network_filesystems)
+    if (static_cast<long>(info.f_type) == type)
+      return false;
+
+  return true;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Start watching a producer directory
+ */
+// ----------------------------------------------------------------------
+
+bool InotifyMonitor::watch(const Producer& theProducer,
+                           const std::filesystem::path& theDirectory,
+                           const boost::regex& thePattern,
+                           unsigned int thePollInterval)
+{
+  try
+  {
+    int wd = addWatch(theDirectory);
+    if (wd < 0)
+      return false;
+
+    itsWatches[wd] = Target{theProducer, theDirectory, thePattern, thePollInterval, {}};
+    return true;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+int InotifyMonitor::addWatch(const std::filesystem::path& theDirectory) const
+{
+  if (itsFd < 0)
+    return -1;
+  return inotify_add_watch(itsFd, theDirectory.c_str(), watch_mask);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Stop using a watch which no longer follows the directory
+ *
+ * The directory is polled until the watch can be restored.
+ */
+// ----------------------------------------------------------------------
+
+void InotifyMonitor::lose(std::map<int, Target>::iterator thePos, bool theRemoveWatch)
+{
+  try
+  {
+    // A renamed directory would still be followed under its new name
+    if (theRemoveWatch)
+      inotify_rm_watch(itsFd, thePos->first);
+
+    auto target = thePos->second;
+    itsWatches.erase(thePos);
+
+    std::cerr << (Spine::log_time_str() + ANSI_FG_YELLOW + " [querydata] Lost inotify watch of " +
+                  target.directory.string() + ", polling it until it reappears" +
+                  ANSI_FG_DEFAULT)
+              << '\n';
+
+    target.nextPoll = std::chrono::steady_clock::now();
+    itsLostWatches.push_back(std::move(target));
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Restore lost watches or poll the directories instead
+ *
+ * The directory is rescanned after the watch is restored, since files
+ * may have been added while it was not being watched.
+ */
+// ----------------------------------------------------------------------
+
+void InotifyMonitor::recover(const RescanCallback& theRescan)
+{
+  try
+  {
+    const auto now = std::chrono::steady_clock::now();
+    for (auto pos = itsLostWatches.begin(); pos != itsLostWatches.end();)
+    {
+      if (pos->nextPoll > now)
+      {
+        ++pos;
+        continue;
+      }
+
+      int wd = addWatch(pos->directory);
+      if (wd >= 0)
+      {
+        std::cerr << (Spine::log_time_str() + ANSI_FG_GREEN +
+                      " [querydata] Restored inotify watch of " + pos->directory.string() +
+                      ANSI_FG_DEFAULT)
+                  << '\n';
+        const auto producer = pos->producer;
+        itsWatches[wd] = *pos;
+        pos = itsLostWatches.erase(pos);
+        rescan(theRescan, producer);
+      }
+      else
+      {
+        pos->nextPoll = now + std::chrono::seconds(pos->pollInterval);
+        rescan(theRescan, pos->producer);
+        ++pos;
+      }
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Request the event loop to stop
+ */
+// ----------------------------------------------------------------------
+
+void InotifyMonitor::stop()
+{
+  itsStopRequested = true;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Pass file events to the callback until stopped
+ */
+// ----------------------------------------------------------------------
+
+void InotifyMonitor::run(const Callback& theCallback, const RescanCallback& theRescan)
+{
+  try
+  {
+    if (itsFd < 0 || itsWatches.empty())
+      return;
+
+    alignas(struct inotify_event) std::array<char, 64 * 1024> buffer;
+
+    while (!itsStopRequested && !Spine::Reactor::isShuttingDown())
+    {
+      boost::this_thread::interruption_point();
+
+      recover(theRescan);
+
+      struct pollfd pfd
+      {
+        itsFd, POLLIN, 0
+      };
+      int ret = poll(&pfd, 1, poll_timeout_ms);
+      if (ret < 0 && errno != EINTR)
+        throw Fmi::Exception(BCP, std::string("inotify poll failed: ") + std::strerror(errno));
+      if (ret <= 0)
+        continue;
+
+      const auto len = read(itsFd, buffer.data(), buffer.size());
+      if (len <= 0)
+        continue;
+
+      bool overflow = false;
+
+      for (const char* ptr = buffer.data(); ptr < buffer.data() + len;)
+      {
+        const auto* event = reinterpret_cast<const struct inotify_event*>(ptr);
+        ptr += sizeof(struct inotify_event) + event->len;
+
+        // Events have been lost, all directories are rescanned once the buffer is processed
+        if ((event->mask & IN_Q_OVERFLOW) != 0)
+        {
+          overflow = true;
+          continue;
+        }
+
+        auto pos = itsWatches.find(event->wd);
+        if (pos == itsWatches.end())
+          continue;
+
+        if ((event->mask & lost_mask) != 0)
+        {
+          lose(pos, (event->mask & IN_IGNORED) == 0);
+          continue;
+        }
+
+        if (event->len == 0 || (event->mask & IN_ISDIR) != 0)
+          continue;
+
+        const auto& target = pos->second;
+        const std::string name = event->name;
+        if (!boost::regex_search(name, target.pattern))
+          continue;
+
+        auto change = REMOVED;
+        if ((event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) != 0)
+          change = ADDED;
+        else if ((event->mask & IN_MODIFY) != 0)
+          change = MODIFIED;
+
+        try
+        {
+          theCallback(target.producer, target.directory / name, change);
+        }
+        catch (...)
+        {
+          Fmi::Exception::Trace(BCP, "Failed to handle directory change")
+              .addParameter("File", (target.directory / name).string())
+              .printError();
+        }
+      }
+
+      if (overflow)
+      {
+        std::cerr << (Spine::log_time_str() + ANSI_FG_YELLOW +
+                      " [querydata] inotify event queue overflow, rescanning directories" +
+                      ANSI_FG_DEFAULT)
+                  << '\n';
+        for (const auto& wd_target : itsWatches)
+          rescan(theRescan, wd_target.second.producer);
+      }
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+}  // namespace Querydata
+}  // namespace Engine
+}  // namespace SmartMet
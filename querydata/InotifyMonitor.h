@@ -0,0 +1,95 @@
+// ======================================================================
+/*!
+ * \brief Event driven monitoring of producer directories
+ *
+ * Uses inotify to notice completed writes (IN_CLOSE_WRITE), files
+ * renamed into place (IN_MOVED_TO), writes (IN_MODIFY) and removed
+ * files immediately.
+ * inotify does not see changes made by other hosts on network file
+ * systems, hence directories on such systems must still be polled
+ * with Fmi::DirectoryMonitor.
+ *
+ * A full directory rescan is requested when the event queue overflows.
+ * If a watched directory is removed or renamed, the watch is restored
+ * once the directory reappears, and the directory is rescanned at the
+ * poll interval of the producer until then.
+ */
+// ======================================================================
+
+#pragma once
+
+#include "Producer.h"
+#include <boost/regex.hpp>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <list>
+#include <map>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Querydata
+{
+class InotifyMonitor
+{
+ public:
+  enum Change
+  {
+    ADDED,
+    MODIFIED,  // being written, possibly in place
+    REMOVED
+  };
+
+  using Callback =
+      std::function<void(const Producer& producer, const std::filesystem::path& path, Change)>;
+  using RescanCallback = std::function<void(const Producer& producer)>;
+
+  ~InotifyMonitor();
+  InotifyMonitor();
+
+  InotifyMonitor(const InotifyMonitor& other) = delete;
+  InotifyMonitor& operator=(const InotifyMonitor& other) = delete;
+  InotifyMonitor(InotifyMonitor&& other) = delete;
+  InotifyMonitor& operator=(InotifyMonitor&& other) = delete;
+
+  // True if the directory is on a local file system where inotify works
+  static bool supported(const std::filesystem::path& theDirectory);
+
+  // Returns false if the directory could not be watched
+  bool watch(const Producer& theProducer,
+             const std::filesystem::path& theDirectory,
+             const boost::regex& thePattern,
+             unsigned int thePollInterval);
+
+  bool empty() const { return itsWatches.empty(); }
+
+  // Process events until stop() is called
+  void run(const Callback& theCallback, const RescanCallback& theRescan);
+  void stop();
+
+ private:
+  struct Target
+  {
+    Producer producer;
+    std::filesystem::path directory;
+    boost::regex pattern;
+    unsigned int pollInterval = 60;
+    std::chrono::steady_clock::time_point nextPoll;  // when the watch has been lost
+  };
+
+  int addWatch(const std::filesystem::path& theDirectory) const;
+  void lose(std::map<int, Target>::iterator thePos, bool theRemoveWatch);
+  void recover(const RescanCallback& theRescan);
+
+  int itsFd = -1;
+  std::map<int, Target> itsWatches;
+  std::list<Target> itsLostWatches;
+  std::atomic<bool> itsStopRequested{false};
+};
+
+}  // namespace Querydata
+}  // namespace Engine
+}  // namespace SmartMet
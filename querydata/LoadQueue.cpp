@@ -0,0 +1,184 @@
+#include "LoadQueue.h"
+#include <macgyver/Exception.h>
+#include <macgyver/ThreadName.h>
+#include <algorithm>
+#include <iostream>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Querydata
+{
+LoadQueue::~LoadQueue()
+{
+  try
+  {
+    stop();
+  }
+  catch (...)
+  {
+    std::cout << Fmi::Exception::Trace(BCP, "EXCEPTION IN DESTRUCTOR!") << '\n';
+  }
+}
+
+LoadQueue::LoadQueue(unsigned int theWorkers, Loader theLoader) : itsLoader(std::move(theLoader))
+{
+  try
+  {
+    for (unsigned int i = 0; i < std::max(1U, theWorkers); i++)
+      itsWorkers.create_thread(
+          [this]()
+          {
+            Fmi::set_thread_name("upd-qd");
+            work();
+          });
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Queue files for loading
+ *
+ * A queued request for the same producer absorbs the new files and
+ * keeps its place in the queue.
+ */
+// ----------------------------------------------------------------------
+
+void LoadQueue::push(const Producer& theProducer, const Files& theFiles, int thePriority)
+{
+  try
+  {
+    if (theFiles.empty())
+      return;
+
+    {
+      std::lock_guard<std::mutex> lock(itsMutex);
+      if (itsStopping)
+        return;
+
+      auto pos = itsQueue.find(theProducer);
+      if (pos == itsQueue.end())
+      {
+        pos = itsQueue.emplace(theProducer, Request()).first;
+        pos->second.sequence = ++itsSequence;
+      }
+
+      auto& request = pos->second;
+      request.priority = std::max(request.priority, thePriority);
+      request.files.insert(theFiles.begin(), theFiles.end());
+    }
+    itsCondition.notify_one();
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Discard queued requests and wait for the workers to finish
+ */
+// ----------------------------------------------------------------------
+
+void LoadQueue::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+    itsStopping = true;
+    itsQueue.clear();
+  }
+  itsCondition.notify_all();
+  itsWorkers.join_all();
+}
+
+bool LoadQueue::idle() const
+{
+  std::lock_guard<std::mutex> lock(itsMutex);
+  return itsQueue.empty() && itsActive.empty();
+}
+
+std::size_t LoadQueue::depth() const
+{
+  std::lock_guard<std::mutex> lock(itsMutex);
+  std::size_t n = 0;
+  for (const auto& producer_request : itsQueue)
+    n += producer_request.second.files.size();
+  return n;
+}
+
+std::size_t LoadQueue::depth(const Producer& theProducer) const
+{
+  std::lock_guard<std::mutex> lock(itsMutex);
+  auto pos = itsQueue.find(theProducer);
+  if (pos == itsQueue.end())
+    return 0;
+  return pos->second.files.size();
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Worker loop
+ */
+// ----------------------------------------------------------------------
+
+void LoadQueue::work()
+{
+  std::unique_lock<std::mutex> lock(itsMutex);
+
+  while (true)
+  {
+    // Select the highest priority and then the oldest request of an idle producer
+    auto best = itsQueue.end();
+    for (auto it = itsQueue.begin(); it != itsQueue.end(); ++it)
+    {
+      if (itsActive.find(it->first) != itsActive.end())
+        continue;
+      if (best == itsQueue.end() || it->second.priority > best->second.priority ||
+          (it->second.priority == best->second.priority &&
+           it->second.sequence < best->second.sequence))
+        best = it;
+    }
+
+    if (itsStopping)
+      return;
+
+    if (best == itsQueue.end())
+    {
+      itsCondition.wait(lock);
+      continue;
+    }
+
+    const Producer producer = best->first;
+    const Files files(best->second.files.begin(), best->second.files.end());
+    itsQueue.erase(best);
+    itsActive.insert(producer);
+
+    lock.unlock();
+    try
+    {
+      itsLoader(producer, files);
+    }
+    catch (...)
+    {
+      Fmi::Exception::Trace(BCP, "Failed to load querydata")
+          .addParameter("Producer", producer)
+          .printError();
+    }
+    lock.lock();
+
+    itsActive.erase(producer);
+
+    // Queued requests of the same producer may now be served
+    itsCondition.notify_all();
+  }
+}
+
+}  // namespace Querydata
+}  // namespace Engine
+}  // namespace SmartMet
@@ -0,0 +1,78 @@
+// ======================================================================
+/*!
+ * \brief Queue of querydata load requests served by a fixed worker pool
+ *
+ * Requests for the same producer are merged while queued, so the queue
+ * never holds more entries than there are producers, and pushing never
+ * blocks. A producer is loaded by at most one worker at a time. Higher
+ * priority producers are served first, otherwise requests are served
+ * in arrival order.
+ */
+// ======================================================================
+
+#pragma once
+
+#include "Producer.h"
+#include <boost/thread.hpp>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Querydata
+{
+class LoadQueue
+{
+ public:
+  using Files = std::vector<std::filesystem::path>;
+  using Loader = std::function<void(const Producer& producer, const Files& files)>;
+
+  ~LoadQueue();
+  LoadQueue(unsigned int theWorkers, Loader theLoader);
+
+  LoadQueue() = delete;
+  LoadQueue(const LoadQueue& other) = delete;
+  LoadQueue& operator=(const LoadQueue& other) = delete;
+  LoadQueue(LoadQueue&& other) = delete;
+  LoadQueue& operator=(LoadQueue&& other) = delete;
+
+  void push(const Producer& theProducer, const Files& theFiles, int thePriority = 0);
+  void stop();
+
+  bool idle() const;          // nothing queued or being loaded
+  std::size_t depth() const;  // number of queued files
+  std::size_t depth(const Producer& theProducer) const;
+
+ private:
+  struct Request
+  {
+    std::set<std::filesystem::path> files;
+    int priority = 0;
+    std::uint64_t sequence = 0;
+  };
+
+  void work();
+
+  Loader itsLoader;
+
+  mutable std::mutex itsMutex;
+  std::condition_variable itsCondition;
+  std::map<Producer, Request> itsQueue;
+  std::set<Producer> itsActive;
+  std::uint64_t itsSequence = 0;
+  bool itsStopping = false;
+
+  boost::thread_group itsWorkers;
+};
+
+}  // namespace Querydata
+}  // namespace Engine
+}  // namespace SmartMet
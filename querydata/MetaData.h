@@ -5,6 +5,7 @@
 #include <macgyver/DateTime.h>
 
 #include <list>
+#include <memory>
 
 namespace SmartMet
 {
@@ -89,6 +90,8 @@ struct MetaData
   std::list<Fmi::DateTime> times;
 };
 
+using MetaDataPtr = std::shared_ptr<const MetaData>;
+
 }  // namespace Querydata
 }  // namespace Engine
 }  // namespace SmartMet
@@ -0,0 +1,188 @@
+#include "MetaDataIndex.h"
+#include "MetaQueryFilters.h"
+#include <boost/algorithm/string/case_conv.hpp>
+#include <macgyver/Exception.h>
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <optional>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Querydata
+{
+namespace bgi = boost::geometry::index;
+
+namespace
+{
+template <typename Map, typename Key>
+const std::vector<std::size_t>& lookup(const Map& theMap, const Key& theKey)
+{
+  static const std::vector<std::size_t> none;
+  auto pos = theMap.find(theKey);
+  if (pos == theMap.end())
+    return none;
+  return pos->second;
+}
+
+// Keep only the candidates present in both sorted lists
+void restrict(std::optional<std::vector<std::size_t>>& theCandidates,
+              const std::vector<std::size_t>& thePostings)
+{
+  if (!theCandidates)
+  {
+    theCandidates = thePostings;
+    return;
+  }
+  std::vector<std::size_t> tmp;
+  std::set_intersection(theCandidates->begin(),
+                        theCandidates->end(),
+                        thePostings.begin(),
+                        thePostings.end(),
+                        std::back_inserter(tmp));
+  theCandidates = std::move(tmp);
+}
+
+bool valid_box(double x1, double y1, double x2, double y2)
+{
+  return (std::isfinite(x1) && std::isfinite(y1) && std::isfinite(x2) && std::isfinite(y2) &&
+          x1 <= x2 && y1 <= y2);
+}
+
+}  // namespace
+
+// Models may have several levels of the same type, hence duplicates are skipped
+void MetaDataIndex::post(Postings& thePostings, std::size_t theId)
+{
+  if (thePostings.empty() || thePostings.back() != theId)
+    thePostings.push_back(theId);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Add the metadata of one model to the index
+ */
+// ----------------------------------------------------------------------
+
+void MetaDataIndex::add(const MetaDataPtr& theMetaData)
+{
+  try
+  {
+    const auto id = itsMetaData.size();
+    itsMetaData.push_back(theMetaData);
+
+    const auto& meta = *theMetaData;
+
+    post(itsProducers[boost::algorithm::to_lower_copy(meta.producer)], id);
+    post(itsOriginTimes[meta.originTime], id);
+
+    for (const auto& param : meta.parameters)
+      post(itsParameters[boost::algorithm::to_lower_copy(param.name)], id);
+
+    for (const auto& level : meta.levels)
+    {
+      post(itsLevelTypes[boost::algorithm::to_lower_copy(level.type)], id);
+      if (!std::isnan(level.value))
+        post(itsLevelValues[level.value], id);
+    }
+
+    if (valid_box(meta.bllon, meta.bllat, meta.urlon, meta.urlat))
+      itsBoxes.insert(
+          std::make_pair(Box(Point(meta.bllon, meta.bllat), Point(meta.urlon, meta.urlat)), id));
+    else
+      itsUnboxed.push_back(id);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Find the metadata matching the options
+ */
+// ----------------------------------------------------------------------
+
+std::list<MetaData> MetaDataIndex::query(const MetaQueryOptions& theOptions) const
+{
+  try
+  {
+    std::optional<Postings> candidates;
+
+    if (theOptions.hasProducer())
+      restrict(candidates,
+               lookup(itsProducers, boost::algorithm::to_lower_copy(theOptions.getProducer())));
+
+    if (theOptions.hasOriginTime())
+      restrict(candidates, lookup(itsOriginTimes, theOptions.getOriginTime()));
+
+    if (theOptions.hasParameters())
+      for (const auto& param : theOptions.getParameters())
+        restrict(candidates, lookup(itsParameters, boost::algorithm::to_lower_copy(param)));
+
+    if (theOptions.hasLevelTypes())
+      for (const auto& type : theOptions.getLevelTypes())
+        restrict(candidates, lookup(itsLevelTypes, boost::algorithm::to_lower_copy(type)));
+
+    if (theOptions.hasLevelValues())
+      for (const auto& value : theOptions.getLevelValues())
+        restrict(candidates, lookup(itsLevelValues, value));
+
+    if (theOptions.hasBoundingBox() && (!candidates || !candidates->empty()))
+    {
+      const auto bbox = theOptions.getBoundingBox();
+      if (valid_box(bbox.bl.X(), bbox.bl.Y(), bbox.ur.X(), bbox.ur.Y()))
+      {
+        const Box box(Point(bbox.bl.X(), bbox.bl.Y()), Point(bbox.ur.X(), bbox.ur.Y()));
+
+        std::vector<RTreeValue> hits;
+        itsBoxes.query(bgi::covers(box), std::back_inserter(hits));
+
+        Postings ids = itsUnboxed;
+        for (const auto& hit : hits)
+          ids.push_back(hit.second);
+        std::sort(ids.begin(), ids.end());
+
+        restrict(candidates, ids);
+      }
+    }
+
+    // Verify the candidates with the actual filters
+
+    auto accept = [&theOptions](const MetaData& meta)
+    {
+      return (filterProducer(meta, theOptions) && filterOriginTime(meta, theOptions) &&
+              filterFirstTime(meta, theOptions) && filterLastTime(meta, theOptions) &&
+              filterParameters(meta, theOptions) && filterLevelTypes(meta, theOptions) &&
+              filterLevelValues(meta, theOptions) && filterBoundingBox(meta, theOptions));
+    };
+
+    std::list<MetaData> ret;
+
+    if (candidates)
+    {
+      for (auto id : *candidates)
+        if (accept(*itsMetaData[id]))
+          ret.push_back(*itsMetaData[id]);
+    }
+    else
+    {
+      for (const auto& meta : itsMetaData)
+        if (accept(*meta))
+          ret.push_back(*meta);
+    }
+
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+}  // namespace Querydata
+}  // namespace Engine
+}  // namespace SmartMet
@@ -0,0 +1,66 @@
+// ======================================================================
+/*!
+ * \brief Index of model metadata for answering MetaQueryOptions queries
+ *
+ * Each model is given a number in insertion order, and sorted lists of
+ * the numbers are kept for each producer, origin time, parameter, level
+ * type and level value. The area corners are kept in an R-tree. A query
+ * intersects the relevant lists and then verifies the candidates with
+ * the regular filters, so the results are identical to filtering all
+ * the metadata one by one.
+ */
+// ======================================================================
+
+#pragma once
+
+#include "MetaData.h"
+#include "MetaQueryOptions.h"
+#include <boost/geometry.hpp>
+#include <boost/geometry/index/rtree.hpp>
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Querydata
+{
+class MetaDataIndex
+{
+ public:
+  // Must be called in the desired output order
+  void add(const MetaDataPtr& theMetaData);
+
+  std::list<MetaData> query(const MetaQueryOptions& theOptions) const;
+
+  std::size_t size() const { return itsMetaData.size(); }
+
+ private:
+  using Postings = std::vector<std::size_t>;
+
+  using Point = boost::geometry::model::point<double, 2, boost::geometry::cs::cartesian>;
+  using Box = boost::geometry::model::box<Point>;
+  using RTreeValue = std::pair<Box, std::size_t>;
+  using RTree = boost::geometry::index::rtree<RTreeValue, boost::geometry::index::quadratic<16>>;
+
+  static void post(Postings& thePostings, std::size_t theId);
+
+  std::vector<MetaDataPtr> itsMetaData;
+
+  std::map<std::string, Postings> itsProducers;  // lower case
+  std::map<Fmi::DateTime, Postings> itsOriginTimes;
+  std::map<std::string, Postings> itsParameters;  // lower case
+  std::map<std::string, Postings> itsLevelTypes;  // lower case
+  std::map<float, Postings> itsLevelValues;
+
+  RTree itsBoxes;
+  Postings itsUnboxed;  // models whose corners do not form a valid box
+};
+
+}  // namespace Querydata
+}  // namespace Engine
+}  // namespace SmartMet
@@ -12,6 +12,7 @@
 #include <newbase/NFmiGeoTools.h>
 #include <newbase/NFmiQueryData.h>
 #include <spine/Convenience.h>
+#include <sys/stat.h>
 
 namespace SmartMet
 {
@@ -65,6 +66,16 @@ Model::Model(Private /* unused */,
     // May throw if file is gone
     itsModificationTime = Fmi::date_time::from_time_t(Fmi::last_write_time(filename));
 
+    // Mapped files must not be modified in place, remember the original state
+    struct stat st;
+    if (mmap && stat(filename.c_str(), &st) == 0)
+    {
+      itsMapped = true;
+      itsInode = st.st_ino;
+      itsFileSize = st.st_size;
+      itsFileModTime = st.st_mtime;
+    }
+
     // Unique hash value for this model
 
     itsHashValue = 0;
@@ -272,6 +283,31 @@ const std::filesystem::path& Model::path() const
 {
   return itsPath;
 }
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Test whether the mapped file has been modified in place
+ *
+ * Accessing pages beyond the end of a truncated file raises SIGBUS.
+ * A file replaced by a rename or removed is safe, since the mapping
+ * keeps the original inode alive.
+ */
+// ----------------------------------------------------------------------
+
+bool Model::isModifiedInPlace() const
+{
+  if (!itsMapped)
+    return false;
+
+  struct stat st;
+  if (stat(itsPath.c_str(), &st) != 0)
+    return false;
+
+  if (st.st_ino != itsInode)
+    return false;
+
+  return (st.st_size != itsFileSize || st.st_mtime != itsFileModTime);
+}
 // ----------------------------------------------------------------------
 /*!
  * \brief Producer accessor
@@ -500,6 +536,32 @@ std::size_t Model::gridHashValue() const
   return itsQueryData->GridHashValue();
 }
 
+// ----------------------------------------------------------------------
+/*!
+ * \brief Return the precalculated metadata
+ */
+// ----------------------------------------------------------------------
+
+MetaDataPtr Model::metaData() const
+{
+  return itsMetaData;
+}
+
+void Model::setMetaData(MetaDataPtr theMetaData)
+{
+  itsMetaData = std::move(theMetaData);
+}
+
+ModelContentPtr Model::content() const
+{
+  return itsContent;
+}
+
+void Model::setContent(ModelContentPtr theContent)
+{
+  itsContent = std::move(theContent);
+}
+
 // ----------------------------------------------------------------------
 /*!
  * \brief Uncache related data
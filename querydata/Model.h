@@ -11,11 +11,14 @@
 
 #pragma once
 
+#include "MetaData.h"
+#include "ModelContent.h"
 #include "Producer.h"
 #include "ValidTimeList.h"
 #include <macgyver/DateTime.h>
 #include <newbase/NFmiFastQueryInfo.h>
 #include <spine/Thread.h>
+#include <sys/types.h>
 #include <filesystem>
 #include <list>
 #include <memory>
@@ -91,6 +94,9 @@ class Model : public boost::enable_shared_from_this<Model>
   std::shared_ptr<ValidTimeList> validTimes() const;
 
   const std::filesystem::path& path() const;
+
+  // True if a memory mapped file has been truncated or rewritten after loading
+  bool isModifiedInPlace() const;
   const Producer& producer() const;
 
   const std::string& levelName() const;
@@ -103,6 +109,12 @@ class Model : public boost::enable_shared_from_this<Model>
 
   std::size_t gridHashValue() const;
 
+  // Metadata calculated when the model was loaded, nullptr for derived data
+  MetaDataPtr metaData() const;
+
+  // Admin content table fields rendered at load time, nullptr for derived data
+  ModelContentPtr content() const;
+
   // Deprecated in WGS84 branch
   void setLatLonCache(const std::shared_ptr<std::vector<NFmiPoint>>& theCache);
   std::shared_ptr<std::vector<NFmiPoint>> makeLatLonCache();
@@ -116,12 +128,20 @@ class Model : public boost::enable_shared_from_this<Model>
   friend struct RepoManager;
   SharedInfo info() const;
   void release(const std::shared_ptr<NFmiFastQueryInfo>& theInfo) const;
+  void setMetaData(MetaDataPtr theMetaData);
+  void setContent(ModelContentPtr theContent);
 
   std::size_t itsHashValue = 0;
   Fmi::DateTime itsOriginTime;
   Fmi::DateTime itsLoadTime;
   std::filesystem::path itsPath;
   Fmi::DateTime itsModificationTime;
+
+  // State of a memory mapped file at load time
+  bool itsMapped = false;
+  ino_t itsInode = 0;
+  off_t itsFileSize = 0;
+  time_t itsFileModTime = 0;
   Producer itsProducer;
   std::string itsLevelName;
   unsigned int itsUpdateInterval = 0;
@@ -133,6 +153,10 @@ class Model : public boost::enable_shared_from_this<Model>
 
   std::shared_ptr<ValidTimeList> itsValidTimeList;
 
+  // Set once before the model is published to the repository
+  MetaDataPtr itsMetaData;
+  ModelContentPtr itsContent;
+
   // Constructing NFmiFastQueryInfo may be slow if there are many
   // time steps or many locations - hence we pool the used infos.
   // The info is returned via a proxy which returns the info back
@@ -0,0 +1,95 @@
+#include "ModelContent.h"
+#include <boost/algorithm/string/join.hpp>
+#include <boost/numeric/conversion/cast.hpp>
+#include <boost/regex.hpp>
+#include <macgyver/Exception.h>
+#include <macgyver/StringConversion.h>
+#include <newbase/NFmiFastQueryInfo.h>
+#include <timeseries/ParameterFactory.h>
+#include <list>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Querydata
+{
+namespace
+{
+// For nicer output in browsers we replace for example ",PROJCS" with ", PROJCS"
+std::string pretty_projection(const std::string& theText)
+{
+  static const boost::regex rex(",([A-Z])");
+  return boost::regex_replace(theText, rex, ", $1");
+}
+}  // namespace
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Render the content table fields of a model
+ */
+// ----------------------------------------------------------------------
+
+ModelContentPtr ModelContent::create(NFmiFastQueryInfo& theInfo)
+{
+  try
+  {
+    auto content = std::make_shared<ModelContent>();
+
+    theInfo.FirstTime();
+    content->minTime = theInfo.ValidTime();
+    theInfo.LastTime();
+    content->maxTime = theInfo.ValidTime();
+
+    for (theInfo.ResetParam(); theInfo.NextParam(true);)
+      content->parameterIds.push_back(FmiParameterName(theInfo.Param().GetParamIdent()));
+
+    std::list<std::string> params;
+    std::list<std::string> descriptions;
+    for (theInfo.ResetParam(); theInfo.NextParam(false);)
+    {
+      int paramID = boost::numeric_cast<int>(theInfo.Param().GetParamIdent());
+      std::string paramName = TimeSeries::ParameterFactory::instance().name(paramID);
+      if (!paramName.empty())
+        params.push_back(paramName);
+      else
+        params.emplace_back(Fmi::to_string(paramID));
+
+      descriptions.emplace_back(theInfo.Param().GetParamName().CharPtr());
+    }
+    content->parameters = boost::algorithm::join(params, ", ");
+    content->descriptions = boost::algorithm::join(descriptions, ", ");
+
+    std::list<std::string> levels;
+    for (theInfo.ResetLevel(); theInfo.NextLevel();)
+    {
+      float level = theInfo.Level()->LevelValue();
+      if (level != kFloatMissing)
+        levels.emplace_back(Fmi::to_string(level));
+      else
+        levels.emplace_back("-");
+    }
+    content->levels = boost::algorithm::join(levels, ", ");
+
+    if (theInfo.Area() == nullptr)
+    {
+      content->wkt = "nan";
+      content->proj = "nan";
+    }
+    else
+    {
+      content->wkt = pretty_projection(theInfo.Area()->WKT());
+      content->proj = pretty_projection(theInfo.Area()->ProjStr());
+    }
+
+    return content;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+}  // namespace Querydata
+}  // namespace Engine
+}  // namespace SmartMet
@@ -0,0 +1,45 @@
+// ======================================================================
+/*!
+ * \brief Model specific parts of the admin content tables
+ *
+ * Rendered once per model so that the admin requests need not iterate
+ * the parameters and levels of every model on each request.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <macgyver/DateTime.h>
+#include <newbase/NFmiParameterName.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+class NFmiFastQueryInfo;
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Querydata
+{
+struct ModelContent;
+using ModelContentPtr = std::shared_ptr<const ModelContent>;
+
+struct ModelContent
+{
+  static ModelContentPtr create(NFmiFastQueryInfo& theInfo);
+
+  std::vector<FmiParameterName> parameterIds;  // excluding subparameters
+  std::string parameters;                      // including subparameters
+  std::string descriptions;
+  std::string levels;
+  std::string wkt;  // "nan" if there is no area
+  std::string proj;
+  Fmi::DateTime minTime;
+  Fmi::DateTime maxTime;
+};
+
+}  // namespace Querydata
+}  // namespace Engine
+}  // namespace SmartMet
@@ -97,6 +97,12 @@ ProducerConfig parse_producerinfo(const Producer &producer, const libconfig::Set
       else if (name == "mmap")
         pinfo.mmap = setting[i];
 
+      else if (name == "load_priority")
+        pinfo.load_priority = setting[i];
+
+      else if (name == "load_parallelism")
+        pinfo.load_parallelism = setting[i];
+
       else if (name == "type")
         pinfo.type = static_cast<const char *>(setting[i]);
 
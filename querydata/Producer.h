@@ -44,6 +44,8 @@ using ProducerList = std::list<std::string>;
  *         update_interval         = "PT1H";
  *         minimum_expires         = "PT5M";
  *         relative_uv             = false;
+ *         load_priority           = 0;
+ *         load_parallelism        = 1;
  * };
  * \endcode
  */
@@ -76,6 +78,8 @@ struct ProducerConfig
   bool isstaticgrid = false;  // by default valid grid points may change during the season
   bool isrelativeuv = false;  // are U/V winds relative to grid orientation
   bool mmap = true;
+  int load_priority = 0;              // producers with higher priority are loaded first
+  unsigned int load_parallelism = 1;  // number of files loaded simultaneously
 
   // Note: If number_to_keep is only one, during the one minute refresh interval a qengine
   // status query might see a new file in some backends and an older one in others. There
@@ -91,10 +95,22 @@ struct ProducerConfig
            c.refresh_interval_secs == refresh_interval_secs && c.leveltype == leveltype &&
            c.type == type && c.pattern_str == pattern_str && c.directory == directory &&
            c.aliases == aliases && c.producer == producer && c.isrelativeuv == isrelativeuv &&
-           c.mmap == mmap;
+           c.mmap == mmap && c.load_priority == load_priority &&
+           c.load_parallelism == load_parallelism;
   }
   bool operator!=(const ProducerConfig& c) const { return !operator==(c); }
 
+  // True if models loaded with either configuration are identical. The other
+  // settings can be changed without reloading the data.
+  bool sameData(const ProducerConfig& c) const
+  {
+    return c.producer == producer && c.directory == directory && c.pattern_str == pattern_str &&
+           c.leveltype == leveltype && c.isclimatology == isclimatology &&
+           c.isfullgrid == isfullgrid && c.isstaticgrid == isstaticgrid &&
+           c.isrelativeuv == isrelativeuv && c.update_interval == update_interval &&
+           c.minimum_expires == minimum_expires && c.mmap == mmap;
+  }
+
   // Monitor index:
 };
 
@@ -1,6 +1,10 @@
 #include "Q.h"
+#include "AstronomyCache.h"
+#include "GridMask.h"
 #include "Model.h"
 #include "WGS84EnvelopeFactory.h"
+#include <boost/asio/post.hpp>
+#include <boost/asio/thread_pool.hpp>
 #include <boost/math/constants/constants.hpp>
 #include <boost/range/algorithm/sort.hpp>
 #include <boost/range/algorithm/unique.hpp>
@@ -13,6 +17,7 @@
 #include <gis/OGR.h>
 #include <gis/SpatialReference.h>
 #include <macgyver/Astronomy.h>
+#include <macgyver/Cache.h>
 #include <macgyver/CharsetTools.h>
 #include <macgyver/DateTime.h>
 #include <macgyver/Exception.h>
@@ -26,10 +31,19 @@
 #include <newbase/NFmiQueryDataUtil.h>
 #include <newbase/NFmiTimeList.h>
 #include <timeseries/ParameterFactory.h>
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cmath>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <mutex>
 #include <ogr_spatialref.h>
 #include <optional>
 #include <stdexcept>
+#include <thread>
 
 namespace SmartMet
 {
@@ -131,6 +145,463 @@ bool is_leap_year(int year)
 // Max interpolation gap
 const int maxgap = 6 * 60;
 
+// ----------------------------------------------------------------------
+/*!
+ * \brief Calculate time interpolation weights
+ *
+ * Returns false if the time is outside the data or if the surrounding
+ * timesteps are further apart than InterpolatedValue would allow.
+ */
+// ----------------------------------------------------------------------
+
+bool calc_time_cache(NFmiFastQueryInfo &theInfo, const NFmiMetTime &theTime, NFmiTimeCache &theCache)
+{
+  theCache = theInfo.CalcTimeCache(theTime);
+
+  if (theCache.itsTimeIndex1 == gMissingIndex || theCache.itsTimeIndex2 == gMissingIndex)
+    return false;
+
+  if (theCache.itsTimeIndex1 == theCache.itsTimeIndex2)
+    return true;
+
+  const auto oldindex = theInfo.TimeIndex();
+  theInfo.TimeIndex(theCache.itsTimeIndex1);
+  const NFmiMetTime t1 = theInfo.ValidTime();
+  theInfo.TimeIndex(theCache.itsTimeIndex2);
+  const NFmiMetTime t2 = theInfo.ValidTime();
+  theInfo.TimeIndex(oldindex);
+
+  return std::abs(t2.DifferenceInMinutes(t1)) <= maxgap;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Is the parameter an angle which must not be blended linearly?
+ *
+ * A plain weighted average of 350 and 10 degrees is 180 degrees, hence
+ * the fast linear paths leave these parameters to newbase.
+ */
+// ----------------------------------------------------------------------
+
+bool is_direction_param(unsigned long theParamId)
+{
+  return (theParamId == kFmiWindDirection || theParamId == kFmiWaveDirection);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Restore the iterator selections when leaving a scope
+ *
+ * Used by methods which iterate over parameters or levels internally
+ * but must not change the state seen by the caller, also on errors.
+ */
+// ----------------------------------------------------------------------
+
+class IteratorStateGuard
+{
+ public:
+  explicit IteratorStateGuard(NFmiFastQueryInfo &theInfo)
+      : itsInfo(theInfo),
+        itsParamIndex(theInfo.ParamIndex()),
+        itsLevelIndex(theInfo.LevelIndex()),
+        itsTimeIndex(theInfo.TimeIndex()),
+        itsLocationIndex(theInfo.LocationIndex())
+  {
+  }
+
+  ~IteratorStateGuard()
+  {
+    itsInfo.ParamIndex(itsParamIndex);
+    itsInfo.LevelIndex(itsLevelIndex);
+    itsInfo.TimeIndex(itsTimeIndex);
+    itsInfo.LocationIndex(itsLocationIndex);
+  }
+
+  IteratorStateGuard(const IteratorStateGuard &other) = delete;
+  IteratorStateGuard &operator=(const IteratorStateGuard &other) = delete;
+
+ private:
+  NFmiFastQueryInfo &itsInfo;
+  unsigned long itsParamIndex;
+  unsigned long itsLevelIndex;
+  unsigned long itsTimeIndex;
+  unsigned long itsLocationIndex;
+};
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Parameter options with a private copy of the location
+ *
+ * Used for evaluating a parameter at many grid points. The same location
+ * is reused for all the points, only the coordinates change.
+ */
+// ----------------------------------------------------------------------
+
+class MovingLocation
+{
+ public:
+  explicit MovingLocation(const ParameterOptions &theOptions)
+      : itsLocation(theOptions.loc.geoid,
+                    theOptions.loc.name,
+                    theOptions.loc.iso2,
+                    theOptions.loc.municipality,
+                    theOptions.loc.area,
+                    theOptions.loc.feature,
+                    theOptions.loc.country,
+                    theOptions.loc.longitude,
+                    theOptions.loc.latitude,
+                    theOptions.loc.timezone,
+                    theOptions.loc.population,
+                    theOptions.loc.elevation,
+                    theOptions.loc.priority),
+        itsOptions(theOptions.par,
+                   theOptions.producer,
+                   itsLocation,
+                   theOptions.country,
+                   theOptions.place,
+                   theOptions.timeformatter,
+                   theOptions.timestring,
+                   theOptions.language,
+                   theOptions.outlocale,
+                   theOptions.outzone,
+                   theOptions.findnearestvalidpoint,
+                   theOptions.maxdist,
+                   theOptions.lastpoint)
+  {
+  }
+
+  MovingLocation(const MovingLocation &other) = delete;
+  MovingLocation &operator=(const MovingLocation &other) = delete;
+
+  void moveTo(double theLongitude, double theLatitude)
+  {
+    itsLocation.longitude = theLongitude;
+    itsLocation.latitude = theLatitude;
+  }
+
+  const ParameterOptions &options() const { return itsOptions; }
+
+ private:
+  Spine::Location itsLocation;
+  ParameterOptions itsOptions;
+};
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Engine wide pool for parallel loops
+ *
+ * The pool is shared by all requests so that the number of threads stays
+ * bounded however many requests run parallel loops concurrently.
+ */
+// ----------------------------------------------------------------------
+
+boost::asio::thread_pool &task_pool()
+{
+  static boost::asio::thread_pool pool(std::max(1U, std::thread::hardware_concurrency()));
+  return pool;
+}
+
+// Set while the thread is running a parallel_for task
+thread_local bool t_InParallelFor = false;
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Run theTask(i) for i=0...n-1 using the task pool
+ *
+ * The calling thread processes indices too, and finishes all of them by
+ * itself if the pool is busy, hence calls cannot deadlock. Helpers
+ * which start late find no work left. Nested calls run serially.
+ */
+// ----------------------------------------------------------------------
+
+void parallel_for(std::size_t n, const std::function<void(std::size_t)> &theTask)
+{
+  if (n == 0)
+    return;
+
+  if (t_InParallelFor || n == 1)
+  {
+    for (std::size_t i = 0; i < n; i++)
+      theTask(i);
+    return;
+  }
+
+  struct State
+  {
+    std::size_t n = 0;
+    const std::function<void(std::size_t)> *task = nullptr;
+    std::atomic<std::size_t> next{0};
+    std::size_t done = 0;
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::condition_variable finished;
+  };
+
+  auto state = std::make_shared<State>();
+  state->n = n;
+  state->task = &theTask;
+
+  auto worker = [state]()
+  {
+    std::size_t count = 0;
+    std::exception_ptr error;
+
+    const bool nested = t_InParallelFor;
+    t_InParallelFor = true;
+    for (auto i = state->next++; i < state->n; i = state->next++)
+    {
+      try
+      {
+        (*state->task)(i);
+      }
+      catch (...)
+      {
+        if (!error)
+          error = std::current_exception();
+      }
+      ++count;
+    }
+    t_InParallelFor = nested;
+
+    if (count == 0)
+      return;
+
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->done += count;
+    if (error && !state->error)
+      state->error = error;
+    if (state->done == state->n)
+      state->finished.notify_all();
+  };
+
+  const std::size_t nhelpers =
+      std::min<std::size_t>(n, std::max(1U, std::thread::hardware_concurrency())) - 1;
+  for (std::size_t i = 0; i < nhelpers; i++)
+    boost::asio::post(task_pool(), worker);
+
+  worker();
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->finished.wait(lock, [&state]() { return state->done == state->n; });
+  if (state->error)
+    std::rethrow_exception(state->error);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Cached source grid coordinates for sampled grids
+ *
+ * The fractional source grid coordinates of each destination grid
+ * point depend only on the source grid and the destination grid, and
+ * calculating them requires two projections per grid point.
+ */
+// ----------------------------------------------------------------------
+
+using SampleGeometry = std::vector<NFmiPoint>;
+using SampleGeometryPtr = std::shared_ptr<const SampleGeometry>;
+
+Fmi::Cache::Cache<std::size_t, SampleGeometryPtr> g_SampleGeometryCache{100};
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Cached horizontal interpolation weights for target grids
+ *
+ * Keyed by the source and target grid hashes.
+ */
+// ----------------------------------------------------------------------
+
+using LocationCaches = std::vector<NFmiLocationCache>;
+using LocationCachesPtr = std::shared_ptr<const LocationCaches>;
+
+Fmi::Cache::Cache<std::size_t, LocationCachesPtr> g_LocationCacheCache{50};
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Cached vertical interpolation positions for target grids
+ *
+ * For each target grid cell the lower level of the two model levels
+ * bracketing the desired pressure or height, and the weight of the
+ * upper level. The pressure and height fields are shared by all
+ * parameters, hence the positions are keyed by the model, the target
+ * grid, the time and the desired level only.
+ */
+// ----------------------------------------------------------------------
+
+struct LevelBracket
+{
+  static constexpr unsigned short missing = std::numeric_limits<unsigned short>::max();
+  std::vector<unsigned short> lower;
+  std::vector<float> weight;
+};
+
+using LevelBracketPtr = std::shared_ptr<const LevelBracket>;
+
+Fmi::Cache::Cache<std::size_t, LevelBracketPtr> g_LevelBracketCache{500};
+
+// Number of grid rows processed by one task
+const std::size_t row_block_size = 16;
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Bilinear interpolation in grid coordinates
+ *
+ * Missing corner values are ignored and the weights of the remaining
+ * corners are normalized. Global data lacking the last column wraps
+ * around to the first one.
+ */
+// ----------------------------------------------------------------------
+
+float bilinear_gather(const NFmiDataMatrix<float> &theValues,
+                      const NFmiPoint &theGridPoint,
+                      bool theGlobeWrap)
+{
+  const double eps = 1e-6;
+  const auto nx = static_cast<long>(theValues.NX());
+  const auto ny = static_cast<long>(theValues.NY());
+
+  double x = theGridPoint.X();
+  double y = theGridPoint.Y();
+
+  if (x == kFloatMissing || y == kFloatMissing || !std::isfinite(x) || !std::isfinite(y))
+    return kFloatMissing;
+
+  const double xmax = (theGlobeWrap ? nx : nx - 1);
+  if (x < -eps || y < -eps || x > xmax + eps || y > ny - 1 + eps)
+    return kFloatMissing;
+
+  x = std::min(std::max(x, 0.0), xmax);
+  y = std::min(std::max(y, 0.0), ny - 1.0);
+
+  auto i1 = std::min(static_cast<long>(x), nx - 1);
+  auto j1 = std::min(static_cast<long>(y), ny - 1);
+  const double dx = x - i1;
+  const double dy = y - j1;
+
+  auto i2 = i1 + 1;
+  if (i2 >= nx)
+    i2 = (theGlobeWrap ? 0 : i1);
+  const auto j2 = std::min(j1 + 1, ny - 1);
+
+  const float corners[4] = {
+      theValues[i1][j1], theValues[i2][j1], theValues[i1][j2], theValues[i2][j2]};
+  const double weights[4] = {(1 - dx) * (1 - dy), dx * (1 - dy), (1 - dx) * dy, dx * dy};
+
+  double sum = 0;
+  double wsum = 0;
+  for (int k = 0; k < 4; k++)
+  {
+    if (corners[k] != kFloatMissing && weights[k] > 0)
+    {
+      sum += weights[k] * corners[k];
+      wsum += weights[k];
+    }
+  }
+
+  if (wsum == 0)
+    return kFloatMissing;
+  return static_cast<float>(sum / wsum);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Change all kFloatMissing values to NaN
+ */
+// ----------------------------------------------------------------------
+
+void set_missing_to_nan(NFmiDataMatrix<float> &values)
+{
+  const std::size_t nx = values.NX();
+  const std::size_t ny = values.NY();
+  if (nx == 0 || ny == 0)
+    return;
+
+  const auto nan = std::numeric_limits<float>::quiet_NaN();
+
+  // Unfortunately NFmiDataMatrix is a vector of vectors, memory
+  // access patterns are not optimal
+
+  for (std::size_t i = 0; i < nx; i++)
+  {
+    auto &tmp = values[i];
+    for (std::size_t j = 0; j < ny; j++)
+      if (tmp[j] == kFloatMissing)
+        tmp[j] = nan;
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Streaming accumulation of area statistics
+ *
+ * The values are retained only if percentiles are needed. Weights
+ * apply to the sum and the mean only.
+ */
+// ----------------------------------------------------------------------
+
+class StatisticsAccumulator
+{
+ public:
+  explicit StatisticsAccumulator(bool keepValues) : itsKeepValues(keepValues) {}
+
+  void add(float theValue, double theWeight = 1)
+  {
+    if (theValue == kFloatMissing)
+    {
+      ++itsMissing;
+      return;
+    }
+    ++itsCount;
+    itsMin = std::min(itsMin, theValue);
+    itsMax = std::max(itsMax, theValue);
+    itsSum += theWeight * theValue;
+    itsWeight += theWeight;
+    if (itsKeepValues)
+      itsValues.push_back(theValue);
+  }
+
+  void addMissing(std::size_t theCount) { itsMissing += theCount; }
+
+  void finish(AreaStatistics &theStats, const std::vector<double> &thePercentiles)
+  {
+    theStats.count = itsCount;
+    theStats.missing = itsMissing;
+    theStats.percentiles.assign(thePercentiles.size(), kFloatMissing);
+
+    if (itsCount == 0)
+      return;
+
+    theStats.min = itsMin;
+    theStats.max = itsMax;
+    theStats.sum = itsSum;
+    theStats.mean = (itsWeight > 0 ? itsSum / itsWeight : kFloatMissing);
+
+    if (thePercentiles.empty())
+      return;
+
+    // Linear interpolation between the closest ranks
+    std::sort(itsValues.begin(), itsValues.end());
+    const auto n = itsValues.size();
+    for (std::size_t i = 0; i < thePercentiles.size(); i++)
+    {
+      const double pos = thePercentiles[i] / 100.0 * static_cast<double>(n - 1);
+      const auto lo = static_cast<std::size_t>(std::floor(pos));
+      const auto hi = std::min(lo + 1, n - 1);
+      const double w = pos - static_cast<double>(lo);
+      theStats.percentiles[i] = (1 - w) * itsValues[lo] + w * itsValues[hi];
+    }
+  }
+
+ private:
+  bool itsKeepValues = false;
+  std::size_t itsCount = 0;
+  std::size_t itsMissing = 0;
+  float itsMin = std::numeric_limits<float>::max();
+  float itsMax = std::numeric_limits<float>::lowest();
+  double itsSum = 0;
+  double itsWeight = 0;
+  std::vector<float> itsValues;
+};
+
 // ----------------------------------------------------------------------
 /*!
  * \brief Is the location of water type?
@@ -1222,6 +1693,14 @@ MetaData QImpl::metaData()
 {
   try
   {
+    // Loaded models have the metadata precalculated
+    if (itsModels.size() == 1)
+    {
+      auto precalculated = itsModels[0]->metaData();
+      if (precalculated)
+        return *precalculated;
+    }
+
     MetaData meta;
 
     // TODO(mheiskan): should not access NFmiFastQueryInfo directly
@@ -1309,7 +1788,7 @@ MetaData QImpl::metaData()
     meta.parameters = params;
 
     // Point data does have an envelope
-    meta.wgs84Envelope = *(WGS84EnvelopeFactory::Get(itsModels[0]->info()));
+    meta.wgs84Envelope = *(WGS84EnvelopeFactory::Get(borrowInfo()));
 
     // Get projection string
     if (qi.Area() == nullptr)
@@ -2032,6 +2511,96 @@ float QImpl::interpolateAtHeight(const NFmiPoint &theLatLon,
   }
 }
 
+// ----------------------------------------------------------------------
+/*!
+ * \brief Extract the vertical profile of the parameters at a point
+ *
+ * With a single grid the horizontal and time interpolation weights are
+ * calculated only once and reused for all levels and parameters.
+ * Parameters missing from the data are left out of the profile.
+ */
+// ----------------------------------------------------------------------
+
+VerticalProfilePtr QImpl::verticalProfile(const NFmiPoint &theLatLon,
+                                          const NFmiMetTime &theTime,
+                                          const std::vector<FmiParameterName> &theParams)
+{
+  try
+  {
+    const auto nlevels = itsInfo->SizeLevels();
+
+    // The caller's selections are restored when returning or throwing
+    IteratorStateGuard guard(*itsInfo);
+
+    const bool cached = (itsModels.size() == 1 && itsInfo->IsGrid());
+
+    NFmiLocationCache lc;
+    NFmiTimeCache tc;
+    bool valid = true;
+    if (cached)
+    {
+      lc = itsInfo->CalcLocationCache(theLatLon);
+      valid = (!lc.NoValue() && calc_time_cache(*itsInfo, theTime, tc));
+    }
+
+    // Interpolated values of the active parameter on all levels. Subparameters
+    // cannot be read with the cached weights.
+    auto column = [&]()
+    {
+      std::vector<float> ret(nlevels, kFloatMissing);
+      const bool fast = (cached && !isSubParamUsed());
+      if (fast && !valid)
+        return ret;
+      for (unsigned long i = 0; i < nlevels; i++)
+      {
+        itsInfo->LevelIndex(i);
+        ret[i] = (fast ? itsInfo->CachedInterpolation(lc, tc)
+                       : itsInfo->InterpolatedValue(theLatLon, theTime, maxgap));
+      }
+      return ret;
+    };
+
+    // Level values as a coordinate column
+    auto levels = [&]()
+    {
+      std::vector<float> ret(nlevels);
+      for (unsigned long i = 0; i < nlevels; i++)
+      {
+        itsInfo->LevelIndex(i);
+        ret[i] = itsInfo->Level()->LevelValue();
+      }
+      return ret;
+    };
+
+    std::vector<float> pressures(nlevels, kFloatMissing);
+    std::vector<float> heights(nlevels, kFloatMissing);
+
+    if (levelType() == kFmiPressureLevel)
+      pressures = levels();
+    else if (param(kFmiPressure))
+      pressures = column();
+
+    if (levelType() == kFmiHeight)
+      heights = levels();
+    else if (param(kFmiGeomHeight) || param(kFmiGeopHeight))
+      heights = column();
+
+    auto profile = std::make_shared<VerticalProfile>(std::move(pressures), std::move(heights));
+
+    for (auto p : theParams)
+    {
+      if (param(p))
+        profile->set(p, column());
+    }
+
+    return profile;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
 // ----------------------------------------------------------------------
 /*!
  * \brief Reset the level iterator
@@ -2561,36 +3130,91 @@ NFmiDataMatrix<float> QImpl::values(const Spine::Parameter &theParam,
 
 // ----------------------------------------------------------------------
 /*!
- * \brief Interpolate values
+ * \brief Time interpolate a native grid in a single pass
+ *
+ * Plain linearly interpolated grid data is read directly from the two
+ * bracketing timesteps and blended in parallel blocks of rows. The
+ * output is called as theOutput(i, j, value) for each non-missing
+ * value only, hence the caller should initialize the output as missing.
+ *
+ * Returns false if the data cannot be handled this way.
  */
 // ----------------------------------------------------------------------
 
-NFmiDataMatrix<float> QImpl::values(const Fmi::CoordinateMatrix &theLatlonMatrix,
-                                    const NFmiMetTime &theTime,
-                                    float P,
-                                    float H)
+template <typename Output>
+bool QImpl::interpolateGrid(const Fmi::DateTime &theInterpolatedTime, Output theOutput)
 {
-  try
-  {
-    return itsInfo->Values(theLatlonMatrix, theTime, P, H);
-  }
-  catch (...)
-  {
-    throw Fmi::Exception::Trace(BCP, "Operation failed!");
-  }
+  const auto paramid = itsInfo->Param().GetParamIdent();
+  if (itsModels.size() != 1 || isSubParamUsed() || !itsInfo->IsGrid() ||
+      is_direction_param(paramid) ||
+      itsInfo->Param().GetParam()->InterpolationMethod() != kLinearly)
+    return false;
+
+  const NFmiMetTime t = theInterpolatedTime;
+  const auto tc = itsInfo->CalcTimeCache(t);
+  if (tc.itsTimeIndex1 == gMissingIndex || tc.itsTimeIndex2 == gMissingIndex)
+    return true;
+
+  const std::size_t nx = itsInfo->GridXNumber();
+  const std::size_t ny = itsInfo->GridYNumber();
+  const auto paramindex = itsInfo->ParamIndex();
+  const auto levelindex = itsInfo->LevelIndex();
+  const float w = tc.itsOffset;
+
+  parallel_for((ny + row_block_size - 1) / row_block_size,
+               [&](std::size_t block)
+               {
+                 const auto jmax = std::min(ny, (block + 1) * row_block_size);
+                 for (auto j = block * row_block_size; j < jmax; j++)
+                 {
+                   for (std::size_t i = 0; i < nx; i++)
+                   {
+                     const auto idx = static_cast<unsigned long>(j * nx + i);
+                     const float v1 = itsInfo->GetFloatValue(
+                         itsInfo->Index(paramindex, idx, levelindex, tc.itsTimeIndex1));
+                     if (v1 == kFloatMissing)
+                       continue;
+                     if (w == 0)
+                     {
+                       theOutput(i, j, v1);
+                       continue;
+                     }
+                     const float v2 = itsInfo->GetFloatValue(
+                         itsInfo->Index(paramindex, idx, levelindex, tc.itsTimeIndex2));
+                     if (v2 != kFloatMissing)
+                       theOutput(i, j, (1 - w) * v1 + w * v2);
+                   }
+                 }
+               });
+
+  return true;
 }
 
 // ----------------------------------------------------------------------
 /*!
- * \brief Extract subgrid values
+ * \brief Extract time interpolated values with missing values as NaN
+ *
+ * Data unsuitable for interpolateGrid is extracted normally and then
+ * converted.
  */
 // ----------------------------------------------------------------------
 
-NFmiDataMatrix<float> QImpl::croppedValues(int x1, int y1, int x2, int y2) const
+NFmiDataMatrix<float> QImpl::nanValues(const Fmi::DateTime &theInterpolatedTime)
 {
   try
   {
-    return itsInfo->CroppedValues(x1, y1, x2, y2);
+    if (itsInfo->IsGrid())
+    {
+      const auto nan = std::numeric_limits<float>::quiet_NaN();
+      NFmiDataMatrix<float> ret(itsInfo->GridXNumber(), itsInfo->GridYNumber(), nan);
+      if (interpolateGrid(theInterpolatedTime,
+                          [&ret](std::size_t i, std::size_t j, float value) { ret[i][j] = value; }))
+        return ret;
+    }
+
+    auto ret = values(theInterpolatedTime);
+    set_missing_to_nan(ret);
+    return ret;
   }
   catch (...)
   {
@@ -2598,18 +3222,21 @@ NFmiDataMatrix<float> QImpl::croppedValues(int x1, int y1, int x2, int y2) const
   }
 }
 
-// ----------------------------------------------------------------------
-/*!
- * \brief Extract values for pressure level
- */
-// ----------------------------------------------------------------------
-
-NFmiDataMatrix<float> QImpl::pressureValues(const NFmiMetTime &theInterpolatedTime,
-                                            float wantedPressureLevel)
+NFmiDataMatrix<float> QImpl::nanValues(const Spine::Parameter &theParam,
+                                       const Fmi::DateTime &theInterpolatedTime)
 {
   try
   {
-    return itsInfo->PressureValues(theInterpolatedTime, wantedPressureLevel);
+    if (theParam.type() == Spine::Parameter::Type::Data)
+    {
+      if (!param(theParam.number()))
+        throw Fmi::Exception(BCP, "Parameter " + theParam.name() + " is not available in the data");
+      return nanValues(theInterpolatedTime);
+    }
+
+    auto ret = values(theParam, theInterpolatedTime);
+    set_missing_to_nan(ret);
+    return ret;
   }
   catch (...)
   {
@@ -2619,18 +3246,242 @@ NFmiDataMatrix<float> QImpl::pressureValues(const NFmiMetTime &theInterpolatedTi
 
 // ----------------------------------------------------------------------
 /*!
- * \brief Extract values for pressure level
+ * \brief Extract time interpolated values into a contiguous buffer
+ *
+ * Plain linearly interpolated data is written directly into the buffer,
+ * other data is converted from the matrix newbase produces.
  */
 // ----------------------------------------------------------------------
 
-NFmiDataMatrix<float> QImpl::pressureValues(const NFmiGrid &theWantedGrid,
-                                            const NFmiMetTime &theInterpolatedTime,
-                                            float wantedPressureLevel)
+GridBuffer QImpl::valuesBuffer(const Fmi::DateTime &theInterpolatedTime, bool theMissingAsNaN)
 {
   try
   {
-    return itsInfo->PressureValues(theWantedGrid, theInterpolatedTime, wantedPressureLevel);
-  }
+    if (itsInfo->IsGrid())
+    {
+      const float missing =
+          (theMissingAsNaN ? std::numeric_limits<float>::quiet_NaN() : kFloatMissing);
+      GridBuffer ret(itsInfo->GridXNumber(), itsInfo->GridYNumber(), missing);
+      if (interpolateGrid(theInterpolatedTime,
+                          [&ret](std::size_t i, std::size_t j, float value) { ret(i, j) = value; }))
+        return ret;
+    }
+
+    auto ret = GridBuffer::fromMatrix(values(theInterpolatedTime));
+    if (theMissingAsNaN)
+      ret.setMissingToNaN();
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+GridBuffer QImpl::valuesBuffer(const Spine::Parameter &theParam,
+                               const Fmi::DateTime &theInterpolatedTime,
+                               bool theMissingAsNaN)
+{
+  try
+  {
+    if (theParam.type() == Spine::Parameter::Type::Data)
+    {
+      if (!param(theParam.number()))
+        throw Fmi::Exception(BCP, "Parameter " + theParam.name() + " is not available in the data");
+      return valuesBuffer(theInterpolatedTime, theMissingAsNaN);
+    }
+
+    auto ret = GridBuffer::fromMatrix(values(theParam, theInterpolatedTime));
+    if (theMissingAsNaN)
+      ret.setMissingToNaN();
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Pressure and height level values as contiguous buffers
+ */
+// ----------------------------------------------------------------------
+
+GridBuffer QImpl::pressureValuesBuffer(const NFmiGrid &theWantedGrid,
+                                       const NFmiMetTime &theInterpolatedTime,
+                                       float wantedPressureLevel,
+                                       bool relative_uv)
+{
+  try
+  {
+    return GridBuffer::fromMatrix(
+        pressureValues(theWantedGrid, theInterpolatedTime, wantedPressureLevel, relative_uv));
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+GridBuffer QImpl::heightValuesBuffer(const NFmiGrid &theWantedGrid,
+                                     const NFmiMetTime &theInterpolatedTime,
+                                     float wantedHeightLevel,
+                                     bool relative_uv)
+{
+  try
+  {
+    return GridBuffer::fromMatrix(
+        heightValues(theWantedGrid, theInterpolatedTime, wantedHeightLevel, relative_uv));
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Zero-copy view to the values of an exact timestep
+ *
+ * Returns nullptr if the time is not a timestep of the data or if the
+ * values cannot be read directly, in which case values() should be
+ * used instead. The view holds a pooled info until it is destroyed.
+ */
+// ----------------------------------------------------------------------
+
+ValuesViewPtr QImpl::valuesView(const Fmi::DateTime &theTime)
+{
+  try
+  {
+    if (itsModels.size() != 1 || isSubParamUsed() || !itsInfo->IsGrid())
+      return {};
+
+    auto info = borrowInfo();
+    info->ParamIndex(itsInfo->ParamIndex());
+    info->LevelIndex(itsInfo->LevelIndex());
+    if (!info->Time(NFmiMetTime(theTime)))
+      return {};
+
+    const auto paramindex = info->ParamIndex();
+    const auto levelindex = info->LevelIndex();
+    const auto timeindex = info->TimeIndex();
+
+    const std::size_t base = info->Index(paramindex, 0, levelindex, timeindex);
+    const std::size_t stride =
+        (info->SizeLocations() > 1 ? info->Index(paramindex, 1, levelindex, timeindex) - base
+                                   : 0);
+
+    const std::size_t nx = info->GridXNumber();
+    const std::size_t ny = info->GridYNumber();
+
+    return std::make_shared<ValuesView>(itsModels[0], std::move(info), base, stride, nx, ny);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+ValuesViewPtr QImpl::valuesView(const Spine::Parameter &theParam, const Fmi::DateTime &theTime)
+{
+  try
+  {
+    if (theParam.type() != Spine::Parameter::Type::Data)
+      return {};
+
+    if (!param(theParam.number()))
+      throw Fmi::Exception(BCP, "Parameter " + theParam.name() + " is not available in the data");
+
+    return valuesView(theTime);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Interpolate values
+ */
+// ----------------------------------------------------------------------
+
+NFmiDataMatrix<float> QImpl::values(const Fmi::CoordinateMatrix &theLatlonMatrix,
+                                    const NFmiMetTime &theTime,
+                                    float P,
+                                    float H)
+{
+  try
+  {
+    return itsInfo->Values(theLatlonMatrix, theTime, P, H);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Extract subgrid values
+ */
+// ----------------------------------------------------------------------
+
+NFmiDataMatrix<float> QImpl::croppedValues(int x1, int y1, int x2, int y2) const
+{
+  try
+  {
+    return itsInfo->CroppedValues(x1, y1, x2, y2);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Extract values for pressure level
+ */
+// ----------------------------------------------------------------------
+
+NFmiDataMatrix<float> QImpl::pressureValues(const NFmiMetTime &theInterpolatedTime,
+                                            float wantedPressureLevel)
+{
+  try
+  {
+    NFmiDataMatrix<float> values;
+    if (itsInfo->IsGrid() &&
+        hybridLevelValues(values, *itsInfo->Grid(), theInterpolatedTime, wantedPressureLevel, true))
+      return values;
+
+    return itsInfo->PressureValues(theInterpolatedTime, wantedPressureLevel);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Extract values for pressure level
+ */
+// ----------------------------------------------------------------------
+
+NFmiDataMatrix<float> QImpl::pressureValues(const NFmiGrid &theWantedGrid,
+                                            const NFmiMetTime &theInterpolatedTime,
+                                            float wantedPressureLevel)
+{
+  try
+  {
+    NFmiDataMatrix<float> values;
+    if (hybridLevelValues(values, theWantedGrid, theInterpolatedTime, wantedPressureLevel, true))
+      return values;
+
+    return itsInfo->PressureValues(theWantedGrid, theInterpolatedTime, wantedPressureLevel);
+  }
   catch (...)
   {
     throw Fmi::Exception::Trace(BCP, "Operation failed!");
@@ -2644,6 +3495,10 @@ NFmiDataMatrix<float> QImpl::pressureValues(const NFmiGrid &theWantedGrid,
 {
   try
   {
+    NFmiDataMatrix<float> values;
+    if (hybridLevelValues(values, theWantedGrid, theInterpolatedTime, wantedPressureLevel, true))
+      return values;
+
     return itsInfo->PressureValues(
         theWantedGrid, theInterpolatedTime, wantedPressureLevel, relative_uv);
   }
@@ -2686,6 +3541,10 @@ NFmiDataMatrix<float> QImpl::heightValues(const NFmiGrid &theWantedGrid,
 {
   try
   {
+    NFmiDataMatrix<float> values;
+    if (hybridLevelValues(values, theWantedGrid, theInterpolatedTime, wantedHeightLevel, false))
+      return values;
+
     return itsInfo->HeightValues(
         theWantedGrid, theInterpolatedTime, wantedHeightLevel, relative_uv);
   }
@@ -2695,6 +3554,204 @@ NFmiDataMatrix<float> QImpl::heightValues(const NFmiGrid &theWantedGrid,
   }
 }
 
+// ----------------------------------------------------------------------
+/*!
+ * \brief Interpolate hybrid level data to a pressure or height level
+ *
+ * The horizontal interpolation weights and the bracketing model levels
+ * of each target grid cell are cached. The latter depend only on the
+ * pressure or height field, and are hence reused for all parameters
+ * requested for the same time and level. The grid is processed in
+ * parallel in blocks of rows.
+ *
+ * Returns false if the data cannot be handled this way, in which case
+ * the caller should let newbase do the interpolation.
+ */
+// ----------------------------------------------------------------------
+
+bool QImpl::hybridLevelValues(NFmiDataMatrix<float> &theValues,
+                              const NFmiGrid &theWantedGrid,
+                              const NFmiMetTime &theTime,
+                              float theLevel,
+                              bool thePressure)
+{
+  try
+  {
+    if (itsModels.size() != 1 || isSubParamUsed() || !itsInfo->IsGrid() ||
+        levelType() != kFmiHybridLevel || itsInfo->SizeLevels() >= LevelBracket::missing)
+      return false;
+
+    // Wind components may need rotation and wind directions are not linear
+    const auto paramid = itsInfo->Param().GetParamIdent();
+    if (paramid == kFmiWindUMS || paramid == kFmiWindVMS || is_direction_param(paramid) ||
+        itsInfo->Param().GetParam()->InterpolationMethod() != kLinearly)
+      return false;
+
+    if (thePressure && theLevel <= 0)
+      return false;
+
+    // The vertical coordinate parameter
+
+    const auto paramindex = itsInfo->ParamIndex();
+    const bool found = (thePressure ? itsInfo->Param(kFmiPressure)
+                                    : (itsInfo->Param(kFmiGeomHeight) ||
+                                       itsInfo->Param(kFmiGeopHeight)));
+    const auto coordindex = itsInfo->ParamIndex();
+    itsInfo->ParamIndex(paramindex);
+
+    if (!found)
+      return false;
+
+    const std::size_t nx = theWantedGrid.XNumber();
+    const std::size_t ny = theWantedGrid.YNumber();
+    const std::size_t nblocks = (ny + row_block_size - 1) / row_block_size;
+    const auto nlevels = itsInfo->SizeLevels();
+
+    theValues = NFmiDataMatrix<float>(nx, ny, kFloatMissing);
+
+    NFmiTimeCache tc;
+    if (!calc_time_cache(*itsInfo, theTime, tc))
+      return true;
+
+    // Horizontal interpolation weights. Projections are not thread safe,
+    // hence these are calculated serially.
+
+    const auto gridhash = theWantedGrid.HashValue();
+
+    std::size_t lchash = gridHashValue();
+    Fmi::hash_combine(lchash, gridhash);
+
+    LocationCachesPtr locations;
+    auto cachedlocations = g_LocationCacheCache.find(lchash);
+    if (cachedlocations)
+      locations = *cachedlocations;
+    else
+    {
+      auto tmp = std::make_shared<LocationCaches>();
+      tmp->reserve(nx * ny);
+      for (std::size_t j = 0; j < ny; j++)
+        for (std::size_t i = 0; i < nx; i++)
+          tmp->push_back(itsInfo->CalcLocationCache(theWantedGrid.GridToLatLon(i, j)));
+      locations = tmp;
+      g_LocationCacheCache.insert(lchash, locations);
+    }
+
+    // Bracketing levels for each cell
+
+    std::size_t bhash = itsHashValue;
+    Fmi::hash_combine(bhash, gridhash);
+    Fmi::hash_combine(bhash, Fmi::hash_value(theTime.PosixTime()));
+    Fmi::hash_combine(bhash, Fmi::hash_value(theLevel));
+    Fmi::hash_combine(bhash, Fmi::hash_value(thePressure));
+
+    LevelBracketPtr bracket;
+    auto cachedbracket = g_LevelBracketCache.find(bhash);
+    if (cachedbracket)
+      bracket = *cachedbracket;
+    else
+    {
+      auto tmp = std::make_shared<LevelBracket>();
+      tmp->lower.assign(nx * ny, LevelBracket::missing);
+      tmp->weight.assign(nx * ny, 0);
+
+      // Pressure is interpolated logarithmically
+      const double target = (thePressure ? std::log(theLevel) : theLevel);
+      const double nan = std::numeric_limits<double>::quiet_NaN();
+
+      parallel_for(
+          nblocks,
+          [&](std::size_t block)
+          {
+            auto info = borrowInfo();
+            info->ParamIndex(coordindex);
+
+            std::vector<double> column(nlevels);
+            const auto jmax = std::min(ny, (block + 1) * row_block_size);
+            for (auto idx = block * row_block_size * nx; idx < jmax * nx; idx++)
+            {
+              const auto &lc = (*locations)[idx];
+              if (lc.NoValue())
+                continue;
+
+              for (unsigned long k = 0; k < nlevels; k++)
+              {
+                info->LevelIndex(k);
+                const float c = info->CachedInterpolation(lc, tc);
+                if (c == kFloatMissing || (thePressure && c <= 0))
+                  column[k] = nan;
+                else
+                  column[k] = (thePressure ? std::log(c) : c);
+              }
+
+              for (unsigned long k = 0; k < nlevels; k++)
+              {
+                const double c1 = column[k];
+                if (c1 == target)
+                {
+                  tmp->lower[idx] = static_cast<unsigned short>(k);
+                  break;
+                }
+                if (k + 1 == nlevels)
+                  break;
+                const double c2 = column[k + 1];
+                if ((c1 < target && target < c2) || (c2 < target && target < c1))
+                {
+                  tmp->lower[idx] = static_cast<unsigned short>(k);
+                  tmp->weight[idx] = static_cast<float>((target - c1) / (c2 - c1));
+                  break;
+                }
+              }
+            }
+          });
+
+      bracket = tmp;
+      g_LevelBracketCache.insert(bhash, bracket);
+    }
+
+    // And finally blend the levels
+
+    parallel_for(nblocks,
+                 [&](std::size_t block)
+                 {
+                   auto info = borrowInfo();
+                   info->ParamIndex(paramindex);
+
+                   const auto jmax = std::min(ny, (block + 1) * row_block_size);
+                   for (auto j = block * row_block_size; j < jmax; j++)
+                   {
+                     for (std::size_t i = 0; i < nx; i++)
+                     {
+                       const auto idx = j * nx + i;
+                       const auto k = bracket->lower[idx];
+                       if (k == LevelBracket::missing)
+                         continue;
+
+                       const auto &lc = (*locations)[idx];
+                       info->LevelIndex(k);
+                       const float v1 = info->CachedInterpolation(lc, tc);
+                       const float w = bracket->weight[idx];
+                       if (w == 0)
+                       {
+                         theValues[i][j] = v1;
+                         continue;
+                       }
+
+                       info->LevelIndex(k + 1);
+                       const float v2 = info->CachedInterpolation(lc, tc);
+                       if (v1 != kFloatMissing && v2 != kFloatMissing)
+                         theValues[i][j] = (1 - w) * v1 + w * v2;
+                     }
+                   }
+                 });
+
+    return true;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
 //----------------------------------------------------------------------
 /*!
  * \brief Return status on whether a sub parameter is active
@@ -2732,17 +3789,17 @@ void QImpl::setIsSubParamUsed(bool theState)
 
 // ----------------------------------------------------------------------
 /*!
- * \brief Extract data value
+ * \brief The time to extract from the data
+ *
+ * Climatologies are stored for a fixed year, hence the year is changed
+ * to match the data.
  */
 // ----------------------------------------------------------------------
 
-TS::Value QImpl::dataValue(const ParameterOptions &opt,
-                           const NFmiPoint &latlon,
-                           const Fmi::LocalDateTime &ldt)
+NFmiMetTime QImpl::dataTime(const Fmi::LocalDateTime &ldt) const
 {
   NFmiMetTime t = ldt;
 
-  // Change the year if the data contains climatology
   if (isClimatology())
   {
     int year = originTime().PosixTime().date().year();
@@ -2753,6 +3810,117 @@ TS::Value QImpl::dataValue(const ParameterOptions &opt,
       t.SetDay(28);
   }
 
+  return t;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Extract data values for grid points of an index mask
+ *
+ * The points are accessed by location index and the time interpolation
+ * weights are calculated only once per timestep instead of once per
+ * point and timestep. The values are stored timestep by timestep for
+ * each point in mask order.
+ *
+ * Returns false if the data cannot be handled this way, in which case
+ * the caller should interpolate point by point.
+ */
+// ----------------------------------------------------------------------
+
+template <typename Times>
+bool QImpl::indexedDataValues(const ParameterOptions &opt,
+                              const NFmiIndexMask &indexmask,
+                              const Times &times,
+                              std::vector<float> &theValues)
+{
+  // Multi-file data may switch files between timesteps, subparameters
+  // are not available via location indices, and directions must not be
+  // interpolated linearly
+  if (itsModels.size() != 1 || isSubParamUsed() ||
+      is_direction_param(itsInfo->Param().GetParamIdent()))
+    return false;
+
+  // Establish the time interpolation weights and the valid timesteps
+  std::vector<NFmiTimeCache> timecaches;
+  std::vector<char> usable;
+  timecaches.reserve(times.size());
+  usable.reserve(times.size());
+
+  for (const auto &ldt : times)
+  {
+    NFmiTimeCache tc;
+    const bool ok = calc_time_cache(*itsInfo, dataTime(ldt), tc);
+    timecaches.push_back(tc);
+    usable.push_back(ok ? 1 : 0);
+  }
+
+  // And extract the values
+
+  const auto ntimes = times.size();
+  theValues.assign(indexmask.size() * ntimes, kFloatMissing);
+
+  std::size_t pos = 0;
+  for (const auto &idx : indexmask)
+  {
+    // Indices outside the grid remain missing
+    const bool inside = itsInfo->LocationIndex(idx);
+
+    for (std::size_t j = 0; inside && j < ntimes; j++)
+    {
+      if (usable[j] != 0)
+        theValues[pos + j] = itsInfo->CachedInterpolation(timecaches[j]);
+    }
+
+    // Search for the nearest valid point only if it is requested
+
+    if (opt.findnearestvalidpoint)
+    {
+      const NFmiPoint latlon = latLon(idx);
+      std::size_t j = 0;
+      for (const auto &ldt : times)
+      {
+        if (theValues[pos + j] == kFloatMissing)
+          theValues[pos + j] = dataFloatValue(opt, latlon, ldt);
+        ++j;
+      }
+    }
+
+    pos += ntimes;
+  }
+
+  return true;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Extract data value
+ */
+// ----------------------------------------------------------------------
+
+TS::Value QImpl::dataValue(const ParameterOptions &opt,
+                           const NFmiPoint &latlon,
+                           const Fmi::LocalDateTime &ldt)
+{
+  float interpolatedValue = dataFloatValue(opt, latlon, ldt);
+
+  if (interpolatedValue == kFloatMissing)
+    return TS::None();
+
+  return interpolatedValue;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Extract data value without boxing it into a TS::Value
+ */
+// ----------------------------------------------------------------------
+
+float QImpl::dataFloatValue(const ParameterOptions &opt,
+                            const NFmiPoint &latlon,
+                            const Fmi::LocalDateTime &ldt)
+{
+  NFmiMetTime t = dataTime(ldt);
+
   float interpolatedValue = interpolate(latlon, t, maxgap);
 
   // If we got no value and the proper flag is on,
@@ -2770,9 +3938,6 @@ TS::Value QImpl::dataValue(const ParameterOptions &opt,
     }
   }
 
-  if (interpolatedValue == kFloatMissing)
-    return TS::None();
-
   return interpolatedValue;
 }
 
@@ -2967,90 +4132,90 @@ TS::Value QImpl::dataIndependentValue(const ParameterOptions &opt,
       return Fmi::Astronomy::moonphase(ldt.utc_time());
     case kFmiMoonrise:
     {
-      auto ltime = Fmi::Astronomy::lunar_time(ldt, loc.longitude, loc.latitude);
-      return opt.timeformatter.format(ltime.moonrise.local_time());
+      auto ltime = AstronomyCache::lunar_time(ldt, loc.longitude, loc.latitude);
+      return opt.timeformatter.format(ltime->moonrise.local_time());
     }
     case kFmiMoonrise2:
     {
-      auto ltime = Fmi::Astronomy::lunar_time(ldt, loc.longitude, loc.latitude);
+      auto ltime = AstronomyCache::lunar_time(ldt, loc.longitude, loc.latitude);
 
-      if (ltime.moonrise2_today())
-        return opt.timeformatter.format(ltime.moonrise2.local_time());
+      if (ltime->moonrise2_today())
+        return opt.timeformatter.format(ltime->moonrise2.local_time());
 
       return std::string("");
     }
     case kFmiMoonset:
     {
-      auto ltime = Fmi::Astronomy::lunar_time(ldt, loc.longitude, loc.latitude);
-      return opt.timeformatter.format(ltime.moonset.local_time());
+      auto ltime = AstronomyCache::lunar_time(ldt, loc.longitude, loc.latitude);
+      return opt.timeformatter.format(ltime->moonset.local_time());
     }
     case kFmiMoonset2:
     {
-      auto ltime = Fmi::Astronomy::lunar_time(ldt, loc.longitude, loc.latitude);
-      if (ltime.moonset2_today())
-        return opt.timeformatter.format(ltime.moonset2.local_time());
+      auto ltime = AstronomyCache::lunar_time(ldt, loc.longitude, loc.latitude);
+      if (ltime->moonset2_today())
+        return opt.timeformatter.format(ltime->moonset2.local_time());
       return std::string("");
     }
     case kFmiMoonriseToday:
     {
-      auto ltime = Fmi::Astronomy::lunar_time(ldt, loc.longitude, loc.latitude);
-      return Fmi::to_string(static_cast<int>(ltime.moonrise_today()));
+      auto ltime = AstronomyCache::lunar_time(ldt, loc.longitude, loc.latitude);
+      return Fmi::to_string(static_cast<int>(ltime->moonrise_today()));
     }
     case kFmiMoonrise2Today:
     {
-      auto ltime = Fmi::Astronomy::lunar_time(ldt, loc.longitude, loc.latitude);
-      return Fmi::to_string(static_cast<int>(ltime.moonrise2_today()));
+      auto ltime = AstronomyCache::lunar_time(ldt, loc.longitude, loc.latitude);
+      return Fmi::to_string(static_cast<int>(ltime->moonrise2_today()));
     }
     case kFmiMoonsetToday:
     {
-      auto ltime = Fmi::Astronomy::lunar_time(ldt, loc.longitude, loc.latitude);
-      return Fmi::to_string(static_cast<int>(ltime.moonset_today()));
+      auto ltime = AstronomyCache::lunar_time(ldt, loc.longitude, loc.latitude);
+      return Fmi::to_string(static_cast<int>(ltime->moonset_today()));
     }
     case kFmiMoonset2Today:
     {
-      auto ltime = Fmi::Astronomy::lunar_time(ldt, loc.longitude, loc.latitude);
-      return Fmi::to_string(static_cast<int>(ltime.moonset2_today()));
+      auto ltime = AstronomyCache::lunar_time(ldt, loc.longitude, loc.latitude);
+      return Fmi::to_string(static_cast<int>(ltime->moonset2_today()));
     }
     case kFmiMoonUp24h:
     {
-      auto ltime = Fmi::Astronomy::lunar_time(ldt, loc.longitude, loc.latitude);
-      return Fmi::to_string(static_cast<int>(ltime.above_horizont_24h()));
+      auto ltime = AstronomyCache::lunar_time(ldt, loc.longitude, loc.latitude);
+      return Fmi::to_string(static_cast<int>(ltime->above_horizont_24h()));
     }
     case kFmiMoonDown24h:
     {
-      auto ltime = Fmi::Astronomy::lunar_time(ldt, loc.longitude, loc.latitude);
-      return Fmi::to_string(static_cast<int>(!ltime.moonrise_today() && !ltime.moonset_today() &&
-                                             !ltime.above_horizont_24h()));
+      auto ltime = AstronomyCache::lunar_time(ldt, loc.longitude, loc.latitude);
+      return Fmi::to_string(static_cast<int>(!ltime->moonrise_today() && !ltime->moonset_today() &&
+                                             !ltime->above_horizont_24h()));
     }
     case kFmiSunrise:
     {
-      auto stime = Fmi::Astronomy::solar_time(ldt, loc.longitude, loc.latitude);
-      return opt.timeformatter.format(stime.sunrise.local_time());
+      auto stime = AstronomyCache::solar_time(ldt, loc.longitude, loc.latitude);
+      return opt.timeformatter.format(stime->sunrise.local_time());
     }
     case kFmiSunset:
     {
-      auto stime = Fmi::Astronomy::solar_time(ldt, loc.longitude, loc.latitude);
-      return opt.timeformatter.format(stime.sunset.local_time());
+      auto stime = AstronomyCache::solar_time(ldt, loc.longitude, loc.latitude);
+      return opt.timeformatter.format(stime->sunset.local_time());
     }
     case kFmiNoon:
     {
-      auto stime = Fmi::Astronomy::solar_time(ldt, loc.longitude, loc.latitude);
-      return Fmi::to_iso_string(stime.noon.local_time());
+      auto stime = AstronomyCache::solar_time(ldt, loc.longitude, loc.latitude);
+      return Fmi::to_iso_string(stime->noon.local_time());
     }
     case kFmiSunriseToday:
     {
-      auto stime = Fmi::Astronomy::solar_time(ldt, loc.longitude, loc.latitude);
-      return Fmi::to_string(static_cast<int>(stime.sunrise_today()));
+      auto stime = AstronomyCache::solar_time(ldt, loc.longitude, loc.latitude);
+      return Fmi::to_string(static_cast<int>(stime->sunrise_today()));
     }
     case kFmiSunsetToday:
     {
-      auto stime = Fmi::Astronomy::solar_time(ldt, loc.longitude, loc.latitude);
-      return Fmi::to_string(static_cast<int>(stime.sunset_today()));
+      auto stime = AstronomyCache::solar_time(ldt, loc.longitude, loc.latitude);
+      return Fmi::to_string(static_cast<int>(stime->sunset_today()));
     }
     case kFmiDayLength:
     {
-      auto stime = Fmi::Astronomy::solar_time(ldt, loc.longitude, loc.latitude);
-      auto seconds = stime.daylength().total_seconds();
+      auto stime = AstronomyCache::solar_time(ldt, loc.longitude, loc.latitude);
+      auto seconds = stime->daylength().total_seconds();
       auto minutes = lround(seconds / 60.0);
       return Fmi::to_string(minutes);
     }
@@ -3589,155 +4754,399 @@ TS::TimeSeriesGroupPtr QImpl::values(const ParameterOptions &param,
   {
     TS::TimeSeriesGroupPtr ret(new TS::TimeSeriesGroup);
 
+    // Plain data can be extracted by location index
+
+    std::vector<float> data;
+    if (param.par.type() == Spine::Parameter::Type::Data && this->param(param.par.number()) &&
+        indexedDataValues(param, indexmask, tlist, data))
+    {
+      std::size_t pos = 0;
+      for (const auto &mask : indexmask)
+      {
+        NFmiPoint latlon(latLon(mask));
+        param.lastpoint = latlon;
+
+        TS::TimeSeries timeseries;
+        for (const Fmi::LocalDateTime &ldt : tlist)
+        {
+          const float value = data[pos++];
+          if (value == kFloatMissing)
+            timeseries.emplace_back(TS::TimedValue(ldt, TS::None()));
+          else
+            timeseries.emplace_back(TS::TimedValue(ldt, value));
+        }
+
+        ret->emplace_back(TS::LonLat(latlon.X(), latlon.Y()), timeseries);
+      }
+      return ret;
+    }
+
+    // The same location is reused for all points, only the coordinates change
+    MovingLocation moving(param);
+
     for (const auto &mask : indexmask)
     {
       // Indexed latlon
       NFmiPoint latlon(latLon(mask));
+      moving.moveTo(latlon.X(), latlon.Y());
 
-      Spine::Location location(param.loc.geoid,
-                               param.loc.name,
-                               param.loc.iso2,
-                               param.loc.municipality,
-                               param.loc.area,
-                               param.loc.feature,
-                               param.loc.country,
-                               latlon.X(),
-                               latlon.Y(),
-                               param.loc.timezone,
-                               param.loc.population,
-                               param.loc.elevation,
-                               param.loc.priority);
+      TS::TimeSeriesPtr timeseries = values(moving.options(), tlist);
+      TS::LonLat lonlat(latlon.X(), latlon.Y());
 
-      ParameterOptions paramOptions(param.par,
-                                    param.producer,
-                                    location,
-                                    param.country,
-                                    param.place,
-                                    param.timeformatter,
-                                    param.timestring,
-                                    param.language,
-                                    param.outlocale,
-                                    param.outzone,
-                                    param.findnearestvalidpoint,
-                                    param.maxdist,
-                                    param.lastpoint);
+      ret->emplace_back(lonlat, *timeseries);
+    }
 
-      TS::TimeSeriesPtr timeseries = values(paramOptions, tlist);
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+TS::TimeSeriesGroupPtr QImpl::valuesAtPressure(const ParameterOptions &param,
+                                               const NFmiIndexMask &indexmask,
+                                               const TS::TimeSeriesGenerator::LocalTimeList &tlist,
+                                               float pressure)
+{
+  try
+  {
+    TS::TimeSeriesGroupPtr ret(new TS::TimeSeriesGroup);
+
+    // The same location is reused for all points, only the coordinates change
+    MovingLocation moving(param);
+
+    for (const auto &mask : indexmask)
+    {
+      // Indexed latlon
+      NFmiPoint latlon(latLon(mask));
+      moving.moveTo(latlon.X(), latlon.Y());
+
+      TS::TimeSeriesPtr timeseries = valuesAtPressure(moving.options(), tlist, pressure);
+      TS::LonLat lonlat(latlon.X(), latlon.Y());
+
+      ret->emplace_back(lonlat, *timeseries);
+    }
+
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+TS::TimeSeriesGroupPtr QImpl::valuesAtHeight(const ParameterOptions &param,
+                                             const NFmiIndexMask &indexmask,
+                                             const TS::TimeSeriesGenerator::LocalTimeList &tlist,
+                                             float height)
+{
+  try
+  {
+    TS::TimeSeriesGroupPtr ret(new TS::TimeSeriesGroup);
+
+    // The same location is reused for all points, only the coordinates change
+    MovingLocation moving(param);
+
+    for (const auto &mask : indexmask)
+    {
+      // Indexed latlon
+      NFmiPoint latlon(latLon(mask));
+      moving.moveTo(latlon.X(), latlon.Y());
+
+      TS::TimeSeriesPtr timeseries = valuesAtHeight(moving.options(), tlist, height);
       TS::LonLat lonlat(latlon.X(), latlon.Y());
 
       ret->emplace_back(lonlat, *timeseries);
     }
 
-    return ret;
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// many locations (indexmask), many timesteps, dense output
+ColumnarValuesPtr QImpl::columnarValues(const ParameterOptions &opt,
+                                        const NFmiIndexMask &indexmask,
+                                        const ColumnarValues::TimeAxisPtr &times)
+{
+  try
+  {
+    std::vector<TS::LonLat> lonlats;
+    lonlats.reserve(indexmask.size());
+    for (const auto &mask : indexmask)
+    {
+      NFmiPoint latlon(latLon(mask));
+      lonlats.emplace_back(latlon.X(), latlon.Y());
+    }
+
+    auto ret = std::make_shared<ColumnarValues>(times, std::move(lonlats));
+    const auto &tlist = *ret->times();
+
+    // Plain data is interpolated straight into the output array
+
+    if (opt.par.type() == Spine::Parameter::Type::Data)
+    {
+      if (!param(opt.par.number()))
+        return ret;
+
+      std::vector<float> data;
+      const bool indexed = indexedDataValues(opt, indexmask, tlist, data);
+
+      for (std::size_t i = 0; i < ret->locationCount(); i++)
+      {
+        const NFmiPoint latlon(ret->lonlat(i).lon, ret->lonlat(i).lat);
+        opt.lastpoint = latlon;
+
+        std::size_t j = 0;
+        for (const auto &ldt : tlist)
+        {
+          if (indexed)
+            ret->set(i, j, data[i * tlist.size() + j]);
+          else
+            ret->set(i, j, dataFloatValue(opt, latlon, ldt));
+          ++j;
+        }
+      }
+      return ret;
+    }
+
+    // Derived parameters may need the location information. The same
+    // location is reused for all points, only the coordinates change.
+
+    MovingLocation moving(opt);
+
+    for (std::size_t i = 0; i < ret->locationCount(); i++)
+    {
+      moving.moveTo(ret->lonlat(i).lon, ret->lonlat(i).lat);
+
+      std::size_t j = 0;
+      for (const auto &ldt : tlist)
+      {
+        const auto result = value(moving.options(), ldt);
+        if (const auto *dvalue = std::get_if<double>(&result))
+          ret->set(i, j, static_cast<float>(*dvalue));
+        else if (const auto *ivalue = std::get_if<int>(&result))
+          ret->set(i, j, static_cast<float>(*ivalue));
+        else if (!std::holds_alternative<TS::None>(result))
+          throw Fmi::Exception(BCP,
+                               "Parameter '" + opt.par.name() +
+                                   "' has non-numeric values, columnar output is not possible");
+        ++j;
+      }
+    }
+
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Borrow a private iterator to the data from the model pool
+ *
+ * Used for processing the data in parallel. The iterator is returned
+ * to the pool when the last copy of the pointer is released.
+ */
+// ----------------------------------------------------------------------
+
+SharedInfo QImpl::borrowInfo() const
+{
+  try
+  {
+    auto model = itsModels[0];
+    auto info = model->info();
+    return SharedInfo(info.get(),
+                      [model, info](NFmiFastQueryInfo * /* unused */)
+                      {
+                        try
+                        {
+                          model->release(info);
+                        }
+                        catch (...)
+                        {
+                        }
+                      });
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Statistics of a parameter over the points of a mask
+ *
+ * Each timestep is reduced in a single pass over the native grid
+ * values, and the timesteps are processed in parallel.
+ */
+// ----------------------------------------------------------------------
+
+AreaStatisticsList QImpl::aggregate(FmiParameterName theParam,
+                                    const NFmiIndexMask &theMask,
+                                    const TS::TimeSeriesGenerator::LocalTimeList &theTimes,
+                                    const std::vector<double> &thePercentiles)
+{
+  try
+  {
+    return aggregatePoints(
+        theParam,
+        theMask.size(),
+        [&theMask](const auto &theVisit)
+        {
+          for (const auto &idx : theMask)
+            theVisit(idx, 1.0);
+        },
+        theTimes,
+        thePercentiles);
   }
   catch (...)
   {
     throw Fmi::Exception::Trace(BCP, "Operation failed!");
   }
 }
-TS::TimeSeriesGroupPtr QImpl::valuesAtPressure(const ParameterOptions &param,
-                                               const NFmiIndexMask &indexmask,
-                                               const TS::TimeSeriesGenerator::LocalTimeList &tlist,
-                                               float pressure)
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Area weighted statistics of a parameter over a grid mask
+ *
+ * Cells near the poles of a latlon grid are much smaller than those
+ * near the equator, the cell areas of the mask are used as weights for
+ * the mean and the sum.
+ */
+// ----------------------------------------------------------------------
+
+AreaStatisticsList QImpl::aggregate(FmiParameterName theParam,
+                                    const GridMaskPtr &theMask,
+                                    const TS::TimeSeriesGenerator::LocalTimeList &theTimes,
+                                    const std::vector<double> &thePercentiles)
 {
   try
   {
-    TS::TimeSeriesGroupPtr ret(new TS::TimeSeriesGroup);
-
-    for (const auto &mask : indexmask)
-    {
-      // Indexed latlon
-      NFmiPoint latlon(latLon(mask));
-
-      Spine::Location location(param.loc.geoid,
-                               param.loc.name,
-                               param.loc.iso2,
-                               param.loc.municipality,
-                               param.loc.area,
-                               param.loc.feature,
-                               param.loc.country,
-                               latlon.X(),
-                               latlon.Y(),
-                               param.loc.timezone,
-                               param.loc.population,
-                               param.loc.elevation,
-                               param.loc.priority);
-
-      ParameterOptions paramOptions(param.par,
-                                    param.producer,
-                                    location,
-                                    param.country,
-                                    param.place,
-                                    param.timeformatter,
-                                    param.timestring,
-                                    param.language,
-                                    param.outlocale,
-                                    param.outzone,
-                                    param.findnearestvalidpoint,
-                                    param.maxdist,
-                                    param.lastpoint);
-
-      TS::TimeSeriesPtr timeseries = valuesAtPressure(paramOptions, tlist, pressure);
-      TS::LonLat lonlat(latlon.X(), latlon.Y());
+    if (!theMask)
+      throw Fmi::Exception(BCP, "Grid mask not set");
 
-      ret->emplace_back(lonlat, *timeseries);
-    }
+    if (theMask->gridHash() != gridHashValue())
+      throw Fmi::Exception(BCP, "Grid mask was created for a different grid");
 
-    return ret;
+    const auto &mask = *theMask;
+    return aggregatePoints(
+        theParam,
+        mask.size(),
+        [&mask](const auto &theVisit)
+        {
+          std::size_t k = 0;
+          for (const auto &run : mask.runs())
+            for (auto idx = run.start; idx < run.start + run.length; idx++)
+              theVisit(idx, mask.weights()[k++]);
+        },
+        theTimes,
+        thePercentiles);
   }
   catch (...)
   {
     throw Fmi::Exception::Trace(BCP, "Operation failed!");
   }
 }
-TS::TimeSeriesGroupPtr QImpl::valuesAtHeight(const ParameterOptions &param,
-                                             const NFmiIndexMask &indexmask,
-                                             const TS::TimeSeriesGenerator::LocalTimeList &tlist,
-                                             float height)
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Common implementation of the aggregate methods
+ *
+ * theForEach(visit) must call visit(locationindex, weight) for each
+ * of the theSize points of the mask.
+ */
+// ----------------------------------------------------------------------
+
+template <typename ForEachPoint>
+AreaStatisticsList QImpl::aggregatePoints(FmiParameterName theParam,
+                                          std::size_t theSize,
+                                          ForEachPoint theForEach,
+                                          const TS::TimeSeriesGenerator::LocalTimeList &theTimes,
+                                          const std::vector<double> &thePercentiles)
 {
   try
   {
-    TS::TimeSeriesGroupPtr ret(new TS::TimeSeriesGroup);
+    for (auto p : thePercentiles)
+    {
+      if (p < 0 || p > 100)
+        throw Fmi::Exception(BCP, "Percentiles must be in the range 0-100")
+            .addParameter("Percentile", Fmi::to_string(p));
+    }
 
-    for (const auto &mask : indexmask)
+    AreaStatisticsList ret;
+    ret.reserve(theTimes.size());
+    std::vector<NFmiMetTime> times;
+    times.reserve(theTimes.size());
+
+    for (const auto &ldt : theTimes)
     {
-      // Indexed latlon
-      NFmiPoint latlon(latLon(mask));
+      ret.emplace_back(ldt);
+      times.push_back(dataTime(ldt));
+    }
 
-      Spine::Location location(param.loc.geoid,
-                               param.loc.name,
-                               param.loc.iso2,
-                               param.loc.municipality,
-                               param.loc.area,
-                               param.loc.feature,
-                               param.loc.country,
-                               latlon.X(),
-                               latlon.Y(),
-                               param.loc.timezone,
-                               param.loc.population,
-                               param.loc.elevation,
-                               param.loc.priority);
+    const bool keepvalues = !thePercentiles.empty();
 
-      ParameterOptions paramOptions(param.par,
-                                    param.producer,
-                                    location,
-                                    param.country,
-                                    param.place,
-                                    param.timeformatter,
-                                    param.timestring,
-                                    param.language,
-                                    param.outlocale,
-                                    param.outzone,
-                                    param.findnearestvalidpoint,
-                                    param.maxdist,
-                                    param.lastpoint);
+    if (!param(theParam))
+    {
+      for (auto &stats : ret)
+      {
+        StatisticsAccumulator acc(false);
+        acc.addMissing(theSize);
+        acc.finish(stats, thePercentiles);
+      }
+      return ret;
+    }
 
-      TS::TimeSeriesPtr timeseries = valuesAtHeight(paramOptions, tlist, height);
-      TS::LonLat lonlat(latlon.X(), latlon.Y());
+    // Multi-file data and subparameters require full interpolation
 
-      ret->emplace_back(lonlat, *timeseries);
+    if (itsModels.size() != 1 || isSubParamUsed())
+    {
+      for (std::size_t i = 0; i < ret.size(); i++)
+      {
+        StatisticsAccumulator acc(keepvalues);
+        theForEach([&](unsigned long idx, double weight)
+                   { acc.add(interpolate(latLon(idx), times[i], maxgap), weight); });
+        acc.finish(ret[i], thePercentiles);
+      }
+      return ret;
     }
 
+    // Each timestep is processed with its own iterator
+
+    const auto paramindex = itsInfo->ParamIndex();
+    const auto levelindex = itsInfo->LevelIndex();
+
+    parallel_for(ret.size(),
+                 [&](std::size_t i)
+                 {
+                   auto info = borrowInfo();
+                   info->ParamIndex(paramindex);
+                   info->LevelIndex(levelindex);
+
+                   StatisticsAccumulator acc(keepvalues);
+                   NFmiTimeCache tc;
+                   if (!calc_time_cache(*info, times[i], tc))
+                     acc.addMissing(theSize);
+                   else
+                   {
+                     theForEach(
+                         [&](unsigned long idx, double weight)
+                         {
+                           if (info->LocationIndex(idx))
+                             acc.add(info->CachedInterpolation(tc), weight);
+                           else
+                             acc.addMissing(1);
+                         });
+                   }
+                   acc.finish(ret[i], thePercentiles);
+                 });
+
     return ret;
   }
   catch (...)
@@ -3884,10 +5293,46 @@ Q QImpl::sample(const Spine::Parameter &theParameter,
 {
   try
   {
-    if (!param(theParameter.number()))
-      throw Fmi::Exception(
-          BCP,
-          "Parameter " + theParameter.name() + " is not available for sampling in the querydata");
+    return sample(std::vector<Spine::Parameter>{theParameter},
+                  std::vector<Fmi::DateTime>{theTime},
+                  theCrs,
+                  theXmin,
+                  theYmin,
+                  theXmax,
+                  theYmax,
+                  theResolution);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Sample several parameters and times into one new Q object
+ *
+ * The projection geometry is established only once for all parameters
+ * and times, which are then sampled in parallel when possible.
+ */
+// ----------------------------------------------------------------------
+
+Q QImpl::sample(const std::vector<Spine::Parameter> &theParameters,
+                const std::vector<Fmi::DateTime> &theTimes,
+                const Fmi::SpatialReference &theCrs,
+                double theXmin,
+                double theYmin,
+                double theXmax,
+                double theYmax,
+                double theResolution)
+{
+  try
+  {
+    if (theParameters.empty())
+      throw Fmi::Exception(BCP, "No parameters given for sampling the querydata");
+
+    if (theTimes.empty())
+      throw Fmi::Exception(BCP, "No times given for sampling the querydata");
 
     if (theResolution <= 0)
       throw Fmi::Exception(BCP, "The sampling resolution must be nonnegative");
@@ -3895,22 +5340,46 @@ Q QImpl::sample(const Spine::Parameter &theParameter,
     if (theResolution < 0.01)
       throw Fmi::Exception(BCP, "Sampling resolutions below 10 meters are not supported");
 
-    if (!itsInfo->TimeDescriptor().IsInside(theTime))
-      throw Fmi::Exception(BCP, "Cannot sample data to a time outside the querydata");
-
     if (!itsInfo->IsGrid())
       throw Fmi::Exception(BCP, "Cannot sample point data to new resolution");
 
+    // NFmiTimeList and NFmiParamBag require unique values, and the times must be sorted
+
+    std::vector<Fmi::DateTime> times = theTimes;
+    std::sort(times.begin(), times.end());
+    times.erase(std::unique(times.begin(), times.end()), times.end());
+
+    std::vector<Spine::Parameter> parameters;
+    for (const auto &parameter : theParameters)
+    {
+      auto same = [&parameter](const Spine::Parameter &other)
+      { return other.number() == parameter.number(); };
+      if (std::none_of(parameters.begin(), parameters.end(), same))
+        parameters.push_back(parameter);
+    }
+
     // Establish the new descriptors
 
     NFmiVPlaceDescriptor vdesc(itsInfo->VPlaceDescriptor());
 
     NFmiParamBag pbag;
-    pbag.Add(itsInfo->Param());
+    for (const auto &parameter : parameters)
+    {
+      if (!param(parameter.number()))
+        throw Fmi::Exception(
+            BCP,
+            "Parameter " + parameter.name() + " is not available for sampling in the querydata");
+      pbag.Add(itsInfo->Param());
+    }
     NFmiParamDescriptor pdesc(pbag);
 
     NFmiTimeList tlist;
-    tlist.Add(new NFmiMetTime(theTime));  // NOLINT(cppcoreguidelines-owning-memory)
+    for (const auto &t : times)
+    {
+      if (!itsInfo->TimeDescriptor().IsInside(t))
+        throw Fmi::Exception(BCP, "Cannot sample data to a time outside the querydata");
+      tlist.Add(new NFmiMetTime(t));  // NOLINT(cppcoreguidelines-owning-memory)
+    }
     NFmiTimeDescriptor tdesc(itsInfo->OriginTime(), tlist);
 
     // Establish new projection and the required grid size of the desired resolution
@@ -3940,8 +5409,248 @@ Q QImpl::sample(const Spine::Parameter &theParameter,
       throw Fmi::Exception(BCP, "Failed to create querydata by sampling");
 
     NFmiFastQueryInfo dstinfo(data.get());
-    dstinfo.First();  // sets the only param and time active
+    dstinfo.First();
+
+    // Plain linearly interpolated data is sampled with a parallel kernel,
+    // anything else point by point. Directions are not linear across north.
+
+    std::vector<SampleTask> tasks;
+
+    for (const auto &parameter : parameters)
+    {
+      if (!param(parameter.number()) || !dstinfo.Param(parameter.number()))
+        throw Fmi::Exception(BCP, "Failed to select parameter for sampling")
+            .addParameter("Parameter", parameter.name());
 
+      const auto paramid = itsInfo->Param().GetParamIdent();
+      const bool linear =
+          (parameter.type() == Spine::Parameter::Type::Data && itsModels.size() == 1 &&
+           !isSubParamUsed() && !is_direction_param(paramid) &&
+           itsInfo->Param().GetParam()->InterpolationMethod() == kLinearly);
+
+      const auto paramindex = itsInfo->ParamIndex();
+
+      for (const auto &t : times)
+      {
+        if (!dstinfo.Time(t))
+          throw Fmi::Exception(BCP, "Failed to select time for sampling")
+              .addParameter("Time", Fmi::to_iso_string(t));
+        if (linear)
+          tasks.push_back(SampleTask{paramindex, dstinfo.ParamIndex(), dstinfo.TimeIndex(), t});
+        else
+          sampleGeneric(dstinfo, parameter, t);
+      }
+    }
+
+    if (!tasks.empty())
+    {
+      std::size_t geomhash = gridHashValue();
+      Fmi::hash_combine(geomhash, Fmi::hash_value(theResolution));
+      Fmi::hash_combine(geomhash, Fmi::hash_value(theXmin));
+      Fmi::hash_combine(geomhash, Fmi::hash_value(theYmin));
+      Fmi::hash_combine(geomhash, Fmi::hash_value(theXmax));
+      Fmi::hash_combine(geomhash, Fmi::hash_value(theYmax));
+      Fmi::hash_combine(geomhash, theCrs.hashValue());
+
+      sampleLinear(*data, tasks, geomhash);
+    }
+
+    // Return the new Q but with a new hash value
+
+    auto hash = sampleHash(
+        theParameters, theTimes, theCrs, theXmin, theYmin, theXmax, theYmax, theResolution);
+
+    auto model = Model::create(*itsModels[0], data, hash);
+    return std::make_shared<QImpl>(model);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Hash value of the data sample() would produce
+ */
+// ----------------------------------------------------------------------
+
+std::size_t QImpl::sampleHash(const Spine::Parameter &theParameter,
+                              const Fmi::DateTime &theTime,
+                              const Fmi::SpatialReference &theCrs,
+                              double theXmin,
+                              double theYmin,
+                              double theXmax,
+                              double theYmax,
+                              double theResolution) const
+{
+  try
+  {
+    return sampleHash(std::vector<Spine::Parameter>{theParameter},
+                      std::vector<Fmi::DateTime>{theTime},
+                      theCrs,
+                      theXmin,
+                      theYmin,
+                      theXmax,
+                      theYmax,
+                      theResolution);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+std::size_t QImpl::sampleHash(const std::vector<Spine::Parameter> &theParameters,
+                              const std::vector<Fmi::DateTime> &theTimes,
+                              const Fmi::SpatialReference &theCrs,
+                              double theXmin,
+                              double theYmin,
+                              double theXmax,
+                              double theYmax,
+                              double theResolution) const
+{
+  try
+  {
+    std::size_t hash = itsHashValue;
+    for (const auto &parameter : theParameters)
+      Fmi::hash_combine(hash, Fmi::hash_value(parameter.name()));
+    Fmi::hash_combine(hash, Fmi::hash_value(theResolution));
+    for (const auto &t : theTimes)
+      Fmi::hash_combine(hash, Fmi::hash_value(t));
+    Fmi::hash_combine(hash, Fmi::hash_value(theXmin));
+    Fmi::hash_combine(hash, Fmi::hash_value(theYmin));
+    Fmi::hash_combine(hash, Fmi::hash_value(theXmax));
+    Fmi::hash_combine(hash, Fmi::hash_value(theYmax));
+    Fmi::hash_combine(hash, theCrs.hashValue());
+    return hash;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Sample linearly interpolated data into the target grid
+ *
+ * The source grid coordinates of the target points are cached. Each
+ * parameter, time and level is then sampled with a bilinear gather
+ * from the time interpolated source grid. With many such combinations
+ * they are processed in parallel, with only a few the rows are
+ * processed in parallel instead.
+ */
+// ----------------------------------------------------------------------
+
+void QImpl::sampleLinear(NFmiQueryData &theTarget,
+                         const std::vector<SampleTask> &theTasks,
+                         std::size_t theGeometryHash)
+{
+  try
+  {
+    NFmiFastQueryInfo dstinfo(&theTarget);
+
+    // Source grid coordinates of the target grid points
+
+    SampleGeometryPtr coords;
+    auto cached = g_SampleGeometryCache.find(theGeometryHash);
+    if (cached)
+      coords = *cached;
+    else
+    {
+      auto geometry = std::make_shared<SampleGeometry>();
+      geometry->reserve(dstinfo.SizeLocations());
+      const auto *grid = itsInfo->Grid();
+      for (dstinfo.ResetLocation(); dstinfo.NextLocation();)
+        geometry->push_back(grid->LatLonToGrid(dstinfo.LatLon()));
+      coords = geometry;
+      g_SampleGeometryCache.insert(theGeometryHash, coords);
+    }
+
+    std::vector<NFmiLevel> levels;
+    for (dstinfo.ResetLevel(); dstinfo.NextLevel();)
+      levels.push_back(*dstinfo.Level());
+
+    const std::size_t width = dstinfo.Grid()->XNumber();
+    const std::size_t height = dstinfo.Grid()->YNumber();
+    const bool wrap = needsGlobeWrap();
+
+    // Sample one parameter, time and level
+
+    std::mutex dstmutex;
+
+    auto process = [&](std::size_t theUnit, bool theParallelRows)
+    {
+      const auto &task = theTasks[theUnit / levels.size()];
+      const auto level = theUnit % levels.size();
+      const NFmiMetTime t = task.time;
+
+      auto info = borrowInfo();
+      info->ParamIndex(task.sourceParam);
+
+      // Do not sample over too long gaps in the data
+      NFmiTimeCache tc;
+      if (!calc_time_cache(*info, t, tc) || !info->Level(levels[level]))
+        return;
+
+      const auto src = info->Values(t);
+
+      std::vector<float> out(width * height, kFloatMissing);
+      auto gather = [&](std::size_t theRow)
+      {
+        for (auto i = theRow * width; i < (theRow + 1) * width; i++)
+          out[i] = bilinear_gather(src, (*coords)[i], wrap);
+      };
+
+      if (theParallelRows)
+        parallel_for(height, gather);
+      else
+      {
+        for (std::size_t row = 0; row < height; row++)
+          gather(row);
+      }
+
+      std::lock_guard<std::mutex> lock(dstmutex);
+      dstinfo.ParamIndex(task.targetParam);
+      dstinfo.TimeIndex(task.targetTime);
+      dstinfo.LevelIndex(level);
+      for (std::size_t i = 0; i < out.size(); i++)
+      {
+        dstinfo.LocationIndex(i);
+        dstinfo.FloatValue(out[i]);
+      }
+    };
+
+    const auto nunits = theTasks.size() * levels.size();
+    if (nunits < std::thread::hardware_concurrency())
+    {
+      for (std::size_t unit = 0; unit < nunits; unit++)
+        process(unit, true);
+    }
+    else
+      parallel_for(nunits, [&](std::size_t unit) { process(unit, false); });
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Sample any parameter into the target grid point by point
+ *
+ * The target must have the desired parameter and time selected.
+ */
+// ----------------------------------------------------------------------
+
+void QImpl::sampleGeneric(NFmiFastQueryInfo &dstinfo,
+                          const Spine::Parameter &theParameter,
+                          const Fmi::DateTime &theTime)
+{
+  try
+  {
     // Now we need all kinds of extra variables because of the damned API
 
     NFmiPoint dummy;
@@ -3979,20 +5688,6 @@ Q QImpl::sample(const Spine::Parameter &theParameter,
           dstinfo.FloatValue(*ptr);
       }
     }
-
-    // Return the new Q but with a new hash value
-
-    std::size_t hash = itsHashValue;
-    Fmi::hash_combine(hash, Fmi::hash_value(theResolution));
-    Fmi::hash_combine(hash, Fmi::hash_value(theTime));
-    Fmi::hash_combine(hash, Fmi::hash_value(theXmin));
-    Fmi::hash_combine(hash, Fmi::hash_value(theYmin));
-    Fmi::hash_combine(hash, Fmi::hash_value(theXmax));
-    Fmi::hash_combine(hash, Fmi::hash_value(theYmax));
-    Fmi::hash_combine(hash, theCrs.hashValue());
-
-    auto model = Model::create(*itsModels[0], data, hash);
-    return std::make_shared<QImpl>(model);
   }
   catch (...)
   {
@@ -4042,6 +5737,17 @@ std::size_t QImpl::gridHashValue() const
   return itsModels.front()->gridHashValue();
 }
 
+// ----------------------------------------------------------------------
+/*!
+ * \brief Return the models the data is based on
+ */
+// ----------------------------------------------------------------------
+
+const std::vector<SharedModel> &QImpl::models() const
+{
+  return itsModels;
+}
+
 // ----------------------------------------------------------------------
 /*!
  * \brief Return true if the data looks global but lacks one grid cell column
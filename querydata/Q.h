@@ -12,10 +12,15 @@
 
 #pragma once
 
+#include "AreaStatistics.h"
+#include "ColumnarValues.h"
+#include "GridBuffer.h"
 #include "MetaData.h"
 #include "Model.h"
 #include "ParameterOptions.h"
 #include "ValidTimeList.h"
+#include "ValuesView.h"
+#include "VerticalProfile.h"
 #include <gis/CoordinateMatrix.h>
 #include <macgyver/DateTime.h>
 #include <newbase/NFmiParameterName.h>
@@ -43,6 +48,9 @@ namespace Engine
 {
 namespace Querydata
 {
+class GridMask;
+using GridMaskPtr = std::shared_ptr<const GridMask>;
+
 class QImpl : public boost::enable_shared_from_this<QImpl>
 {
  public:
@@ -69,6 +77,7 @@ class QImpl : public boost::enable_shared_from_this<QImpl>
 
   std::size_t hashValue() const;
   std::size_t gridHashValue() const;
+  const std::vector<SharedModel>& models() const;
 
   NFmiPoint validPoint(const NFmiPoint& theLatLon, double theMaxDist, const NFmiMetTime& theTime) const;
 
@@ -134,6 +143,11 @@ class QImpl : public boost::enable_shared_from_this<QImpl>
                             float theHeight,
                             int theMaxMinuteGap = 0);
 
+  // all levels of the parameters at one point and time, the iterator state is kept
+  VerticalProfilePtr verticalProfile(const NFmiPoint& theLatLon,
+                                     const NFmiMetTime& theTime,
+                                     const std::vector<FmiParameterName>& theParams);
+
   NFmiPoint latLon(long theIndex) const;
 
   bool isSubParamUsed() const;
@@ -165,6 +179,21 @@ class QImpl : public boost::enable_shared_from_this<QImpl>
   NFmiDataMatrix<float> values(const Spine::Parameter& theParam,
                                const Fmi::DateTime& theInterpolatedTime);
 
+  // Same as above, but with missing values as NaN
+  NFmiDataMatrix<float> nanValues(const Fmi::DateTime& theInterpolatedTime);
+  NFmiDataMatrix<float> nanValues(const Spine::Parameter& theParam,
+                                  const Fmi::DateTime& theInterpolatedTime);
+
+  // Contiguous alternatives to the above
+  GridBuffer valuesBuffer(const Fmi::DateTime& theInterpolatedTime, bool theMissingAsNaN);
+  GridBuffer valuesBuffer(const Spine::Parameter& theParam,
+                          const Fmi::DateTime& theInterpolatedTime,
+                          bool theMissingAsNaN);
+
+  // Exact timesteps without copying, nullptr if not possible
+  ValuesViewPtr valuesView(const Fmi::DateTime& theTime);
+  ValuesViewPtr valuesView(const Spine::Parameter& theParam, const Fmi::DateTime& theTime);
+
   // For arbitrary coordinates:
 
   NFmiDataMatrix<float> values(const Fmi::CoordinateMatrix& theLatlonMatrix,
@@ -195,6 +224,15 @@ class QImpl : public boost::enable_shared_from_this<QImpl>
                                      float wantedHeightLevel,
                                      bool relative_uv);
 
+  GridBuffer pressureValuesBuffer(const NFmiGrid& theWantedGrid,
+                                  const NFmiMetTime& theInterpolatedTime,
+                                  float wantedPressureLevel,
+                                  bool relative_uv);
+  GridBuffer heightValuesBuffer(const NFmiGrid& theWantedGrid,
+                                const NFmiMetTime& theInterpolatedTime,
+                                float wantedHeightLevel,
+                                bool relative_uv);
+
   // sample data into a new projection
 
   std::shared_ptr<QImpl> sample(const Spine::Parameter& theParameter,
@@ -206,6 +244,36 @@ class QImpl : public boost::enable_shared_from_this<QImpl>
                                 double theYmax,
                                 double theResolution);
 
+  std::size_t sampleHash(const Spine::Parameter& theParameter,
+                         const Fmi::DateTime& theTime,
+                         const Fmi::SpatialReference& theCrs,
+                         double theXmin,
+                         double theYmin,
+                         double theXmax,
+                         double theYmax,
+                         double theResolution) const;
+
+  // many parameters and times sampled at once into a single new projection. The times
+  // are sorted and duplicate times and parameters are ignored.
+
+  std::shared_ptr<QImpl> sample(const std::vector<Spine::Parameter>& theParameters,
+                                const std::vector<Fmi::DateTime>& theTimes,
+                                const Fmi::SpatialReference& theCrs,
+                                double theXmin,
+                                double theYmin,
+                                double theXmax,
+                                double theYmax,
+                                double theResolution);
+
+  std::size_t sampleHash(const std::vector<Spine::Parameter>& theParameters,
+                         const std::vector<Fmi::DateTime>& theTimes,
+                         const Fmi::SpatialReference& theCrs,
+                         double theXmin,
+                         double theYmin,
+                         double theXmax,
+                         double theYmax,
+                         double theResolution) const;
+
   // one location, one timestep
   TS::Value value(const ParameterOptions& opt, const Fmi::LocalDateTime& ldt);
   TS::Value valueAtPressure(const ParameterOptions& opt,
@@ -233,6 +301,20 @@ class QImpl : public boost::enable_shared_from_this<QImpl>
                                         const NFmiIndexMask& indexmask,
                                         const TS::TimeSeriesGenerator::LocalTimeList& tlist,
                                         float height);
+  // many locations (indexmask), many timesteps as dense float arrays
+  ColumnarValuesPtr columnarValues(const ParameterOptions& param,
+                                   const NFmiIndexMask& indexmask,
+                                   const ColumnarValues::TimeAxisPtr& times);
+  // statistics over many locations (indexmask), many timesteps
+  AreaStatisticsList aggregate(FmiParameterName theParam,
+                               const NFmiIndexMask& theMask,
+                               const TS::TimeSeriesGenerator::LocalTimeList& theTimes,
+                               const std::vector<double>& thePercentiles = {});
+  // as above, but the mean and sum are weighted by the cell areas of the mask
+  AreaStatisticsList aggregate(FmiParameterName theParam,
+                               const GridMaskPtr& theMask,
+                               const TS::TimeSeriesGenerator::LocalTimeList& theTimes,
+                               const std::vector<double>& thePercentiles = {});
   // many locations (llist), many timesteps
   TS::TimeSeriesGroupPtr values(const ParameterOptions& param,
                                 const Spine::LocationList& llist,
@@ -266,6 +348,50 @@ class QImpl : public boost::enable_shared_from_this<QImpl>
   TS::Value dataValue(const ParameterOptions& opt,
                       const NFmiPoint& latlon,
                       const Fmi::LocalDateTime& ldt);
+  float dataFloatValue(const ParameterOptions& opt,
+                       const NFmiPoint& latlon,
+                       const Fmi::LocalDateTime& ldt);
+  NFmiMetTime dataTime(const Fmi::LocalDateTime& ldt) const;
+
+  SharedInfo borrowInfo() const;
+
+  bool hybridLevelValues(NFmiDataMatrix<float>& theValues,
+                         const NFmiGrid& theWantedGrid,
+                         const NFmiMetTime& theTime,
+                         float theLevel,
+                         bool thePressure);
+
+  // One parameter and time to be sampled with the linear kernel
+  struct SampleTask
+  {
+    unsigned long sourceParam;  // parameter index in the source data
+    unsigned long targetParam;  // parameter index in the sampled data
+    unsigned long targetTime;   // time index in the sampled data
+    Fmi::DateTime time;
+  };
+
+  void sampleLinear(NFmiQueryData& theTarget,
+                    const std::vector<SampleTask>& theTasks,
+                    std::size_t theGeometryHash);
+  void sampleGeneric(NFmiFastQueryInfo& theTarget,
+                     const Spine::Parameter& theParameter,
+                     const Fmi::DateTime& theTime);
+
+  template <typename ForEachPoint>
+  AreaStatisticsList aggregatePoints(FmiParameterName theParam,
+                                     std::size_t theSize,
+                                     ForEachPoint theForEach,
+                                     const TS::TimeSeriesGenerator::LocalTimeList& theTimes,
+                                     const std::vector<double>& thePercentiles);
+
+  template <typename Output>
+  bool interpolateGrid(const Fmi::DateTime& theInterpolatedTime, Output theOutput);
+
+  template <typename Times>
+  bool indexedDataValues(const ParameterOptions& opt,
+                         const NFmiIndexMask& indexmask,
+                         const Times& times,
+                         std::vector<float>& theValues);
   TS::Value dataValueAtPressure(const ParameterOptions& opt,
                                 const NFmiPoint& latlon,
                                 const Fmi::LocalDateTime& ldt,
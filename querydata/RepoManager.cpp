@@ -28,9 +28,12 @@
 // ======================================================================
 
 #include "RepoManager.h"
+#include "CoordinateFileCache.h"
 #include "Model.h"
 #include "Producer.h"
+#include "Q.h"
 #include "Repository.h"
+#include "SharedMemoryRegistry.h"
 #include <boost/bind/bind.hpp>
 #include <macgyver/AnsiEscapeCodes.h>
 #include <macgyver/Exception.h>
@@ -44,8 +47,11 @@
 #include <spine/Convenience.h>
 #include <spine/Exceptions.h>
 #include <spine/Reactor.h>
+#include <algorithm>
 #include <cassert>
+#include <ctime>
 #include <filesystem>
+#include <future>
 #include <memory>
 #include <set>
 #include <sstream>
@@ -60,6 +66,12 @@ namespace Querydata
 {
 namespace
 {
+// Files not modified for this many seconds are not probed for being incomplete
+const std::time_t stable_file_age = 10;
+
+// Limit the retry delay to 2^6 times the initial delay
+const unsigned int max_retry_shift = 6;
+
 // ----------------------------------------------------------------------
 /*!
  * \brief Return a setting, which may have a host specific value
@@ -129,10 +141,15 @@ RepoManager::~RepoManager()
   try
   {
     boost::this_thread::disable_interruption do_not_disturb;
+    itsInotifyMonitor.stop();
+    if (itsLoadQueue)
+      itsLoadQueue->stop();
     itsExpirationThread.interrupt();
     itsMonitorThread.interrupt();
+    itsInotifyThread.interrupt();
     itsExpirationThread.join();
     itsMonitorThread.join();
+    itsInotifyThread.join();
   }
   catch (...)
   {
@@ -152,9 +169,7 @@ RepoManager::~RepoManager()
 
 RepoManager::RepoManager(const std::string& configfile)
     : itsVerbose(false),
-      updateTasks(new Fmi::AsyncTaskGroup),
-      itsMaxThreadCount(10),  // default if not configured
-      itsThreadCount(0)
+      itsMaxThreadCount(10)  // default if not configured
 {
   std::error_code ec;
 
@@ -195,6 +210,12 @@ RepoManager::RepoManager(const std::string& configfile)
 
       lookupHostSetting(itsConfig, itsMaxThreadCount, "maxthreads", hostname);
       lookupHostSetting(itsConfig, itsVerbose, "verbose", hostname);
+      lookupHostSetting(itsConfig, itsInotifyEnabled, "inotify", hostname);
+      lookupHostSetting(itsConfig, itsInotifyRescanInterval, "inotify_rescan_interval", hostname);
+      lookupHostSetting(itsConfig, itsStabilityProbes, "load_stability_probes", hostname);
+      lookupHostSetting(itsConfig, itsStabilityInterval, "load_stability_interval_ms", hostname);
+      lookupHostSetting(itsConfig, itsMaxRetries, "load_retries", hostname);
+      lookupHostSetting(itsConfig, itsRetryDelay, "load_retry_delay", hostname);
       itsRepo.verbose(itsVerbose);
 
       // Phase 1: Establish producer setting
@@ -230,9 +251,6 @@ RepoManager::RepoManager(const std::string& configfile)
 
       if (!ec)
         this->configModTime = modtime;
-
-      updateTasks->on_task_error([](const std::string& /* unused */)
-                                 { Fmi::Exception::Trace(BCP, "Operation failed").printError(); });
     }
     catch (...)
     {
@@ -271,12 +289,20 @@ void RepoManager::init()
                       ANSI_FG_DEFAULT)
                   << '\n';
 
+      // Local directories report changes immediately, the scans are only a safety net
+      // for lost events. Network file systems must be polled.
+
+      if (itsInotifyEnabled && InotifyMonitor::supported(pinfo.directory) &&
+          itsInotifyMonitor.watch(
+              pinfo.producer, pinfo.directory, pinfo.pattern, pinfo.refresh_interval_secs))
+        itsInotifyProducers.insert(pinfo.producer);
+
       auto data_id =
           itsMonitor.watch(pinfo.directory,
                            pinfo.pattern,
                            boost::bind(&RepoManager::update, this, _1, _2, _3, _4),
                            boost::bind(&RepoManager::error, this, _1, _2, _3, _4),
-                           pinfo.refresh_interval_secs,
+                           scanInterval(pinfo.producer),
                            Fmi::DirectoryMonitor::CREATE | Fmi::DirectoryMonitor::DELETE |
                                Fmi::DirectoryMonitor::SCAN);
 
@@ -285,14 +311,28 @@ void RepoManager::init()
       itsRepo.add(pinfo);
       itsProducerList.push_back(pinfo.producer);
       itsProducerMap.insert(ProducerMap::value_type(data_id, pinfo.producer));
+
+      adoptOldModels(pinfo);
     }
 
+    itsLoadQueue = std::make_unique<LoadQueue>(
+        std::max(1, itsMaxThreadCount),
+        [this](const Producer& producer, const Files& files) { load(producer, files); });
+
     itsMonitorThread = boost::thread(
         [this]()
         {
           Fmi::set_thread_name("upd-qd-mon");
           itsMonitor.run();
         });
+    if (!itsInotifyMonitor.empty())
+      itsInotifyThread = boost::thread(
+          [this]()
+          {
+            Fmi::set_thread_name("upd-qd-ino");
+            itsInotifyMonitor.run(boost::bind(&RepoManager::notify, this, _1, _2, _3),
+                                  boost::bind(&RepoManager::rescan, this, _1));
+          });
     itsExpirationThread = boost::thread(
         [this]()
         {
@@ -308,7 +348,63 @@ void RepoManager::init()
 
 // ----------------------------------------------------------------------
 /*!
- * \brief Data expiration loop
+ * \brief Take over the models of the previous manager
+ *
+ * On configuration reloads producers whose data settings have not
+ * changed keep their models, the new settings such as aliases and
+ * refresh intervals apply immediately. The initial directory scan
+ * then loads only files which are not loaded yet.
+ *
+ * The directory monitors cannot be taken over in the same way. A
+ * Fmi::DirectoryMonitor watcher is bound to the callbacks of the
+ * manager which created it and cannot be rebound or removed, and the
+ * old manager is discarded once the new one is ready. The new monitors
+ * merely rescan the directories, which is cheap compared to loading.
+ */
+// ----------------------------------------------------------------------
+
+void RepoManager::adoptOldModels(const ProducerConfig& conf)
+{
+  try
+  {
+    if (!itsOldRepoManager)
+      return;
+
+    Repository::SharedModels models;
+    {
+      Spine::ReadLock lock(itsOldRepoManager->itsMutex);
+      const auto& oldconfigs = itsOldRepoManager->itsConfigList;
+      auto oldconf = std::find_if(oldconfigs.begin(),
+                                  oldconfigs.end(),
+                                  [&conf](const ProducerConfig& c)
+                                  { return c.producer == conf.producer; });
+      if (oldconf == oldconfigs.end() || !oldconf->sameData(conf))
+        return;
+      models = itsOldRepoManager->itsRepo.getAllModels(conf.producer);
+    }
+
+    if (models.empty())
+      return;
+
+    Spine::WriteLock lock(itsMutex);
+    for (const auto& time_model : models)
+      itsRepo.add(conf.producer, time_model.second);
+    itsRepo.resize(conf.producer, conf.number_to_keep);
+
+    if (itsVerbose)
+      std::cout << Spine::log_time_str() + " QENGINE ADOPTED " + Fmi::to_string(models.size()) +
+                       " models for " + conf.producer
+                << '\n';
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Data expiration and load retry loop
  */
 // ----------------------------------------------------------------------
 
@@ -316,9 +412,12 @@ void RepoManager::expirationLoop()
 {
   while (!Spine::Reactor::isShuttingDown())
   {
-    // Wait 30 seconds. TODO: use condition variable
+    // Wait 30 seconds retrying deferred loads meanwhile. TODO: use condition variable
     for (int i = 0; i < 10 * 30 && !Spine::Reactor::isShuttingDown(); i++)
+    {
       boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
+      retryLoads();
+    }
 
     if (Spine::Reactor::isShuttingDown())
       break;
@@ -368,15 +467,19 @@ void RepoManager::shutdown()
   {
     std::cout << "  -- Shutdown requested (RepoManager)\n";
     itsMonitor.stop();
+    itsInotifyMonitor.stop();
 
     if (itsMonitorThread.joinable())
       itsMonitorThread.join();
 
+    if (itsInotifyThread.joinable())
+      itsInotifyThread.join();
+
     if (itsExpirationThread.joinable())
       itsExpirationThread.join();
 
-    updateTasks->stop();
-    updateTasks->wait();
+    if (itsLoadQueue)
+      itsLoadQueue->stop();
   }
   catch (...)
   {
@@ -449,8 +552,10 @@ void RepoManager::error(Fmi::DirectoryMonitor::Watcher /* id */,
  * if any callback request notices a modified file, we will
  * reload it. Users should not trust that the mechanism is safe,
  * since any access to deleted data is likely to cause a bus error.
- * It would be pure luck to notice a deleted file before someone
- * uses it.
+ * Mapped files truncated or rewritten in place are unloaded on each
+ * scan, and immediately when watched with inotify, but readers may
+ * still access the data before that. Producers which rewrite files
+ * in place should use mmap = false.
  */
 // ----------------------------------------------------------------------
 
@@ -471,12 +576,15 @@ void RepoManager::update(Fmi::DirectoryMonitor::Watcher id,
     {
       if (file_status.second == Fmi::DirectoryMonitor::SCAN)
       {
-        const ProducerConfig& conf = producerConfig(producer);
         auto scan_time = Fmi::SecondClock::universal_time();
-        auto next_scan_time = (scan_time + Fmi::Seconds(conf.refresh_interval_secs));
+        auto next_scan_time = (scan_time + Fmi::Seconds(scanInterval(producer)));
 
-        Spine::WriteLock lock(itsMutex);
-        itsRepo.updateProducerStatus(producer, scan_time, next_scan_time);
+        {
+          Spine::WriteLock lock(itsMutex);
+          itsRepo.updateProducerStatus(producer, scan_time, next_scan_time);
+        }
+
+        retireModifiedModels(producer);
       }
 
       if (file_status.second == Fmi::DirectoryMonitor::DELETE ||
@@ -492,6 +600,385 @@ void RepoManager::update(Fmi::DirectoryMonitor::Watcher id,
       }
     }
 
+    handleChanges(producer, std::move(removals), std::move(additions));
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Inotify callback function
+ *
+ * A rewritten file is both removed and added, unless the change has
+ * already been handled by a directory scan.
+ */
+// ----------------------------------------------------------------------
+
+void RepoManager::notify(const Producer& producer,
+                         const std::filesystem::path& path,
+                         InotifyMonitor::Change change)
+{
+  try
+  {
+    // Writes to a mapped file would crash the readers, the new version is
+    // loaded once the write completes
+    if (change == InotifyMonitor::MODIFIED)
+    {
+      SharedModel model;
+      {
+        Spine::ReadLock lock(itsMutex);
+        model = itsRepo.getModel(producer, path);
+      }
+      if (model && model->isModifiedInPlace())
+        retireModifiedModels(producer);
+      return;
+    }
+
+    Files removals;
+    Files additions;
+
+    if (change != InotifyMonitor::REMOVED)
+    {
+      additions.push_back(path);
+      if (!isLoaded(producer, path))
+        markComplete(path);
+    }
+
+    {
+      Spine::ReadLock lock(itsMutex);
+      if (itsRepo.getModel(producer, path))
+        removals.push_back(path);
+    }
+
+    handleChanges(producer, std::move(removals), std::move(additions));
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Rescan a producer directory
+ *
+ * Called when inotify events may have been lost, or when the directory
+ * is polled because its watch has been lost. Loaded files which are
+ * still current are skipped by handleChanges.
+ */
+// ----------------------------------------------------------------------
+
+void RepoManager::rescan(const Producer& producer)
+{
+  try
+  {
+    const auto& conf = producerConfig(producer);
+
+    Files additions;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(conf.directory, ec))
+    {
+      const auto name = entry.path().filename().string();
+      if (entry.is_regular_file(ec) && boost::regex_search(name, conf.pattern))
+        additions.push_back(conf.directory / name);
+    }
+
+    Files removals;
+    {
+      Spine::ReadLock lock(itsMutex);
+      for (const auto& time_model : itsRepo.getAllModels(producer))
+        removals.push_back(time_model.second->path());
+    }
+
+    handleChanges(producer, std::move(removals), std::move(additions));
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Test whether the current version of the file has been loaded
+ */
+// ----------------------------------------------------------------------
+
+bool RepoManager::isLoaded(const Producer& producer, const std::filesystem::path& path) const
+{
+  try
+  {
+    std::error_code ec;
+    const auto modtime = Fmi::last_write_time(path, ec);
+    if (ec)
+      return false;
+
+    Spine::ReadLock lock(itsMutex);
+    auto model = itsRepo.getModel(producer, path);
+    return (model && model->modificationTime() == Fmi::date_time::from_time_t(modtime));
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Directory scan interval for the producer
+ */
+// ----------------------------------------------------------------------
+
+unsigned int RepoManager::scanInterval(const Producer& producer) const
+{
+  const auto& conf = producerConfig(producer);
+  if (itsInotifyProducers.find(producer) == itsInotifyProducers.end())
+    return conf.refresh_interval_secs;
+  return std::max(conf.refresh_interval_secs, itsInotifyRescanInterval);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Test whether the file appears to be completely written
+ *
+ * The size and modification time must stay the same over the probes.
+ * Files which have not been modified recently are not probed.
+ */
+// ----------------------------------------------------------------------
+
+bool RepoManager::isStable(const std::filesystem::path& path) const
+{
+  try
+  {
+    std::error_code ec;
+    auto size = std::filesystem::file_size(path, ec);
+    if (ec)
+      return false;
+    auto modtime = Fmi::last_write_time(path, ec);
+    if (ec)
+      return false;
+
+    if (std::time(nullptr) - modtime > stable_file_age)
+      return true;
+
+    for (unsigned int probe = 1; probe < itsStabilityProbes; probe++)
+    {
+      boost::this_thread::sleep_for(boost::chrono::milliseconds(itsStabilityInterval));
+
+      auto newsize = std::filesystem::file_size(path, ec);
+      if (ec || newsize != size)
+        return false;
+      auto newmodtime = Fmi::last_write_time(path, ec);
+      if (ec || newmodtime != modtime)
+        return false;
+    }
+    return true;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Remember a file inotify reported as completely written
+ *
+ * IN_CLOSE_WRITE and IN_MOVED_TO are reported only after the writer
+ * is done, hence the file need not be probed for stability.
+ */
+// ----------------------------------------------------------------------
+
+void RepoManager::markComplete(const std::filesystem::path& path)
+{
+  try
+  {
+    std::error_code ec;
+    const auto modtime = Fmi::last_write_time(path, ec);
+    if (ec)
+      return;
+
+    std::lock_guard<std::mutex> lock(itsRetryMutex);
+    itsCompleteFiles[path] = modtime;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Test whether inotify reported the current version of the file complete
+ */
+// ----------------------------------------------------------------------
+
+bool RepoManager::isComplete(const std::filesystem::path& path)
+{
+  try
+  {
+    std::time_t modtime = 0;
+    {
+      std::lock_guard<std::mutex> lock(itsRetryMutex);
+      auto pos = itsCompleteFiles.find(path);
+      if (pos == itsCompleteFiles.end())
+        return false;
+      modtime = pos->second;
+      itsCompleteFiles.erase(pos);
+    }
+
+    // The file may have been rewritten since
+    std::error_code ec;
+    return (Fmi::last_write_time(path, ec) == modtime && !ec);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Schedule a new load attempt for the file
+ *
+ * Incomplete files are probed again after the stability interval,
+ * failed loads after an exponentially growing delay.
+ */
+// ----------------------------------------------------------------------
+
+void RepoManager::retryLater(const Producer& producer,
+                             const std::filesystem::path& path,
+                             bool failed)
+{
+  try
+  {
+    std::lock_guard<std::mutex> lock(itsRetryMutex);
+    auto& retry = itsRetries[path];
+    retry.producer = producer;
+
+    auto delay = std::chrono::milliseconds(itsStabilityInterval);
+    if (failed)
+    {
+      delay = std::chrono::seconds(itsRetryDelay << std::min(retry.failures, max_retry_shift));
+      ++retry.failures;
+    }
+    retry.next = std::chrono::steady_clock::now() + delay;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Start the deferred loads which are due
+ */
+// ----------------------------------------------------------------------
+
+void RepoManager::retryLoads()
+{
+  try
+  {
+    std::map<Producer, Files> due;
+    {
+      std::lock_guard<std::mutex> lock(itsRetryMutex);
+      const auto now = std::chrono::steady_clock::now();
+      for (auto& path_retry : itsRetries)
+      {
+        auto& retry = path_retry.second;
+        if (retry.next <= now)
+        {
+          due[retry.producer].push_back(path_retry.first);
+          // Wait for the attempt to finish before the next one
+          retry.next = std::chrono::steady_clock::time_point::max();
+        }
+      }
+    }
+
+    for (auto& producer_files : due)
+    {
+      const auto& producer = producer_files.first;
+      auto& files = producer_files.second;
+
+      // Forget files which have been removed or loaded meanwhile
+      auto obsolete = [&](const std::filesystem::path& path)
+      {
+        if (std::filesystem::exists(path) && !isLoaded(producer, path))
+          return false;
+        std::lock_guard<std::mutex> lock(itsRetryMutex);
+        itsRetries.erase(path);
+        return true;
+      };
+      files.erase(std::remove_if(files.begin(), files.end(), obsolete), files.end());
+
+      if (!files.empty())
+        handleChanges(producer, {}, std::move(files));
+    }
+  }
+  catch (...)
+  {
+    Fmi::Exception::Trace(BCP, "Failed to retry loading querydata").printError();
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Remove models whose mapped files have been modified in place
+ */
+// ----------------------------------------------------------------------
+
+void RepoManager::retireModifiedModels(const Producer& producer)
+{
+  try
+  {
+    Files modified;
+    {
+      Spine::ReadLock lock(itsMutex);
+      for (const auto& time_model : itsRepo.getAllModels(producer))
+        if (time_model.second->isModifiedInPlace())
+          modified.push_back(time_model.second->path());
+    }
+
+    if (modified.empty())
+      return;
+
+    Spine::WriteLock lock(itsMutex);
+    for (const auto& file : modified)
+    {
+      std::cerr << (Spine::log_time_str() + ANSI_FG_RED + " [querydata] Mapped file " +
+                    file.string() + " was modified in place, unloading it" + ANSI_FG_DEFAULT)
+                << '\n';
+      itsRepo.remove(producer, file);
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Remove deleted files and schedule loading new ones
+ *
+ * Both the directory scans and inotify may report the same file, and
+ * the first scan reports files adopted from the previous manager.
+ * Hence files whose current version is already loaded are skipped.
+ */
+// ----------------------------------------------------------------------
+
+void RepoManager::handleChanges(const Producer& producer, Files removals, Files additions)
+{
+  try
+  {
+    auto loaded = [&](const std::filesystem::path& path) { return isLoaded(producer, path); };
+    removals.erase(std::remove_if(removals.begin(), removals.end(), loaded), removals.end());
+    additions.erase(std::remove_if(additions.begin(), additions.end(), loaded), additions.end());
+
     if (removals.empty() && additions.empty())
     {
       // Nothing to update
@@ -513,36 +1000,17 @@ void RepoManager::update(Fmi::DirectoryMonitor::Watcher id,
     if (additions.empty())
       return;
 
-    // We limit the number of threads to avoid exhausting the system
-
-    bool ok = false;
-    while (!ok && !Spine::Reactor::isShuttingDown())
-    {
-      {
-        if (itsThreadCount <= itsMaxThreadCount)
-          ok = true;
-      }
-      if (!ok)
-        boost::this_thread::sleep_for(boost::chrono::milliseconds(50));
-    }
-
     // Abort if there is a shut down request
     if (Spine::Reactor::isShuttingDown())
       return;
 
-    // Note: We are really counting scheduled threads, not
-    // ones which have actually started. Hence the counter
-    // should be here and not in the load method.
-    ++itsThreadCount;
+    // Handle new or modified files. The workers limit the number of simultaneous
+    // loads, and this thread continues monitoring immediately.
 
-    // Handle new or modified files
+    itsLoadQueue->push(producer, additions, producerConfig(producer).load_priority);
 
-#if 0
-	std::cerr << ANSI_FG_GREEN << "Threads: " << itsThreadCount
-			  << " " << filename << ANSI_FG_DEFAULT << '\n';
-#endif
-    updateTasks->handle_finished();
-    updateTasks->add("upd-qd", std::bind(&RepoManager::load, this, producer, additions));
+    Spine::WriteLock lock(itsMutex);
+    itsRepo.updateProducerQueue(producer, itsLoadQueue->depth(producer));
   }
   catch (...)
   {
@@ -550,11 +1018,125 @@ void RepoManager::update(Fmi::DirectoryMonitor::Watcher id,
   }
 }
 
+// ----------------------------------------------------------------------
+/*!
+ * \brief Load a single file or take it from the old repository
+ *
+ * Returns the model and whether it was loaded from disk. The model is
+ * empty if the file is still being written. Throws if the file cannot
+ * be loaded.
+ */
+// ----------------------------------------------------------------------
+
+std::pair<SharedModel, bool> RepoManager::loadModel(const ProducerConfig& conf,
+                                                    const std::filesystem::path& filename,
+                                                    bool try_old_repo)
+{
+  SharedModel model;
+
+  // Try using the old repo if it is available
+
+  if (try_old_repo)
+  {
+    Spine::ReadLock lock(itsOldRepoManager->itsMutex);
+
+    // Failure to get old data is not an error here
+    try
+    {
+      model = itsOldRepoManager->itsRepo.getModel(conf.producer, filename);
+    }
+    catch (...)
+    {
+    }
+  }
+
+  const bool load_new_data = !model;
+
+  // Load directly if the old repo was not useful
+  if (load_new_data)
+  {
+    // Files still being copied would fail to load or be truncated when mapped
+    if (!isComplete(filename) && !isStable(filename))
+    {
+      retryLater(conf.producer, filename, false);
+      return {};
+    }
+
+    if (itsVerbose)
+      std::cout << Spine::log_time_str() + " QENGINE LOAD " + filename.string() << '\n';
+
+    model = Model::create(filename,
+                          conf.producer,
+                          conf.leveltype,
+                          conf.isclimatology,
+                          conf.isfullgrid,
+                          conf.isstaticgrid,
+                          conf.isrelativeuv,
+                          conf.update_interval,
+                          conf.minimum_expires,
+                          conf.mmap);
+
+    // Metadata queries are frequent, calculate it once here
+    QImpl q(model);
+    model->setMetaData(std::make_shared<const MetaData>(q.metaData()));
+
+    // And so are the admin content tables
+    auto info = model->info();
+    model->setContent(ModelContent::create(*info));
+    model->release(info);
+  }
+
+  if (itsVerbose && load_new_data)
+  {
+    std::ostringstream msg;
+    msg << Spine::log_time_str() << " QENGINE ORIGINTIME for " << filename << " is "
+        << model->originTime() << " HASH VALUE is " << hash_value(*model) << "\n";
+
+    std::cout << msg.str() << std::flush;
+  }
+
+  // Update latlon-cache if necessary. In any case make sure model cache is up to date
+  // WARNING: DEPRECATED CODE BLOCK IN WGS84 MODE - THE RETURNED SHARED_PTR IS EMPTY
+
+  auto hash = model->gridHashValue();
+  auto latlons = itsLatLonCache.find(hash);  // cached coordinates, if any
+  if (!latlons)
+  {
+    // Prefer latlons published by another process on the same host or saved by an earlier run
+    auto info = model->info();
+    const std::size_t npoints = info->SizeLocations();
+    model->release(info);
+
+    auto shared = SharedMemoryRegistry::FindLatLons(hash, npoints);
+    if (shared)
+      model->setLatLonCache(shared);
+    else
+    {
+      shared = CoordinateFileCache::FindLatLons(hash, npoints);
+      if (shared)
+        model->setLatLonCache(shared);
+      else
+      {
+        shared = model->makeLatLonCache();  // request latlons
+        if (shared)
+          CoordinateFileCache::SaveLatLons(hash, *shared);
+      }
+      if (shared)
+        SharedMemoryRegistry::PublishLatLons(hash, *shared);
+    }
+    itsLatLonCache.insert(hash, shared);
+  }
+  else
+    model->setLatLonCache(*latlons);  // set model cache from our cache
+
+  return {model, load_new_data};
+}
+
 // ----------------------------------------------------------------------
 /*!
  * \brief Querydata loader function
  *
- * This should be run as a separate thread. Arguments are
+ * This is run by the load queue workers. Arguments are
  * copies instead of references intentionally.
  */
 // ----------------------------------------------------------------------
@@ -563,9 +1145,11 @@ void RepoManager::load(Producer producer,  // NOLINT(performance-unnecessary-val
                        Files files)        // NOLINT(performance-unnecessary-value-param)
 {
   if (Spine::Reactor::isShuttingDown())
-  {
-    --itsThreadCount;
     return;
+
+  {
+    Spine::WriteLock lock(itsMutex);
+    itsRepo.updateProducerQueue(producer, itsLoadQueue->depth(producer));
   }
 
   // We expect timestamps and want the newest file first
@@ -584,14 +1168,16 @@ void RepoManager::load(Producer producer,  // NOLINT(performance-unnecessary-val
   {
   }
 
-  // Do not use old repo if configuration has changed
+  // Do not use old repo if the data would be different
 
-  const bool try_old_repo = (oldconf && *oldconf == conf);
+  const bool try_old_repo = (oldconf && oldconf->sameData(conf));
 
   unsigned int successful_loads = 0;
   Fmi::DateTime data_load_time(Fmi::DateTime::NOT_A_DATE_TIME);
 
-  for (const auto& filename : files)
+  const std::size_t parallelism = std::max(1U, conf.load_parallelism);
+
+  for (auto next = files.begin(); next != files.end();)
   {
     if (Spine::Reactor::isShuttingDown())
       break;
@@ -600,106 +1186,121 @@ void RepoManager::load(Producer producer,  // NOLINT(performance-unnecessary-val
     if (successful_loads >= conf.number_to_keep)
       break;
 
-    // files may be corrupt, hence we catch exceptions
-    try
-    {
-      SharedModel model;
+    // Open as many of the next candidates as are still needed concurrently. The
+    // first one is loaded by this thread.
 
-      // Try using the old repo if it is available
+    const std::size_t n = std::min({parallelism,
+                                    std::size_t(conf.number_to_keep - successful_loads),
+                                    std::size_t(files.end() - next)});
+    const Files candidates(next, next + n);
+    next += n;
 
-      if (try_old_repo)
-      {
-        Spine::ReadLock lock(itsOldRepoManager->itsMutex);
+    std::vector<std::future<std::pair<SharedModel, bool>>> results;
+    for (std::size_t i = 0; i < candidates.size(); i++)
+    {
+      const auto policy = (i == 0 ? std::launch::deferred : std::launch::async);
+      results.push_back(std::async(policy,
+                                   [this, &conf, &candidates, i, try_old_repo]()
+                                   { return loadModel(conf, candidates[i], try_old_repo); }));
+    }
 
-        // Failure to get old data is not an error here
-        try
-        {
-          model = itsOldRepoManager->itsRepo.getModel(producer, filename);
-        }
-        catch (...)
-        {
-        }
-      }
+    // Insert in the original order, failures fall through to the next candidates
 
-      const bool load_new_data = !model;
+    for (std::size_t i = 0; i < candidates.size(); i++)
+    {
+      const auto& filename = candidates[i];
 
-      // Load directly if the old repo was not useful
-      if (load_new_data)
+      // files may be corrupt, hence we catch exceptions
+      try
       {
-        if (itsVerbose)
-          std::cout << Spine::log_time_str() + " QENGINE LOAD " + filename.string() << '\n';
-
-        model = Model::create(filename,
-                              conf.producer,
-                              conf.leveltype,
-                              conf.isclimatology,
-                              conf.isfullgrid,
-                              conf.isstaticgrid,
-                              conf.isrelativeuv,
-                              conf.update_interval,
-                              conf.minimum_expires,
-                              conf.mmap);
-
-        data_load_time = Fmi::SecondClock::universal_time();
-      }
+        auto [model, is_new] = results[i].get();
 
-      if (itsVerbose && load_new_data)
-      {
-        std::ostringstream msg;
-        msg << Spine::log_time_str() << " QENGINE ORIGINTIME for " << filename << " is "
-            << model->originTime() << " HASH VALUE is " << hash_value(*model) << "\n";
+        // Deferred if incomplete
+        if (!model)
+          continue;
 
-        std::cout << msg.str() << std::flush;
-      }
+        if (is_new)
+          data_load_time = Fmi::SecondClock::universal_time();
 
-      // Update latlon-cache if necessary. In any case make sure model cache is up to date
-      // WARNING: DEPRECATED CODE BLOCK IN WGS84 MODE - THE RETURNED SHARED_PTR IS EMPTY
+        {
+          // update structures safely
 
-      auto hash = model->gridHashValue();
-      auto latlons = itsLatLonCache.find(hash);  // cached coordinates, if any
-      if (!latlons)
-        itsLatLonCache.insert(hash, model->makeLatLonCache());  // request latlons and cache them
-      else
-        model->setLatLonCache(*latlons);  // set model cache from our cache
+          Spine::WriteLock lock(itsMutex);
+          itsRepo.add(producer, model);
+          ++successful_loads;
+          itsRepo.resize(producer, conf.number_to_keep);
+        }
 
+        std::lock_guard<std::mutex> lock(itsRetryMutex);
+        itsRetries.erase(filename);
+      }
+      catch (...)
       {
-        // update structures safely
+        if (Spine::Reactor::isShuttingDown())
+          continue;
 
-        Spine::WriteLock lock(itsMutex);
-        itsRepo.add(producer, model);
-        ++successful_loads;
-        itsRepo.resize(producer, conf.number_to_keep);
-      }
-    }
-    catch (...)
-    {
-      if (Spine::Reactor::isShuttingDown())
-        break;
+        Fmi::Exception exception(BCP, "QEngine failed to load the file!", nullptr);
+        exception.addParameter("File", filename.c_str());
 
-      Fmi::Exception exception(BCP, "QEngine failed to load the file!", nullptr);
-      exception.addParameter("File", filename.c_str());
-      std::cerr << exception.getStackTrace();
+        // Report only the final failure in detail
+        bool retry = false;
+        {
+          std::lock_guard<std::mutex> lock(itsRetryMutex);
+          auto pos = itsRetries.find(filename);
+          const unsigned int failures = (pos == itsRetries.end() ? 0 : pos->second.failures);
+          retry = (failures < itsMaxRetries);
+        }
+
+        if (retry)
+        {
+          std::cerr << (Spine::log_time_str() + ANSI_FG_YELLOW + " [querydata] Failed to load " +
+                        filename.string() + ", retrying later" + ANSI_FG_DEFAULT)
+                    << '\n';
+          retryLater(producer, filename, true);
+        }
+        else
+        {
+          std::cerr << exception.getStackTrace();
+          std::lock_guard<std::mutex> lock(itsRetryMutex);
+          itsRetries.erase(filename);
+        }
+      }
     }
   }  // for all files
 
+  // Files skipped above will be probed if they are ever loaded
+  {
+    std::lock_guard<std::mutex> lock(itsRetryMutex);
+    for (const auto& filename : files)
+      itsCompleteFiles.erase(filename);
+  }
+
   if (!Spine::Reactor::isShuttingDown())
   {
     Spine::WriteLock lock(itsMutex);
     itsRepo.updateProducerStatus(producer, data_load_time, itsRepo.getAllModels(producer).size());
   }
-
-  --itsThreadCount;
 }
 
 // ----------------------------------------------------------------------
 /*!
  * \brief Return true if the repositories have been scanned at least once
+ *
+ * Deferred and retried loads must also have finished, or the initial
+ * data would be incomplete.
  */
 // ----------------------------------------------------------------------
 
 bool RepoManager::ready() const
 {
-  return (itsConfigList.empty() || (itsThreadCount == 0 && itsMonitor.ready()));
+  if (itsConfigList.empty())
+    return true;
+
+  if (!itsLoadQueue || !itsLoadQueue->idle() || !itsMonitor.ready())
+    return false;
+
+  std::lock_guard<std::mutex> lock(itsRetryMutex);
+  return itsRetries.empty();
 }
 // ----------------------------------------------------------------------
 /*!
@@ -6,15 +6,19 @@
 
 #pragma once
 
+#include "InotifyMonitor.h"
+#include "LoadQueue.h"
 #include "Repository.h"
-#include <boost/atomic.hpp>
 #include <boost/thread.hpp>
-#include <macgyver/AsyncTaskGroup.h>
 #include <macgyver/Cache.h>
 #include <macgyver/DirectoryMonitor.h>
 #include <spine/Thread.h>
+#include <chrono>
 #include <filesystem>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <set>
 
 namespace SmartMet
 {
@@ -54,6 +58,12 @@ struct RepoManager
              const boost::regex& pattern,
              const std::string& message);
 
+  void notify(const Producer& producer,
+              const std::filesystem::path& path,
+              InotifyMonitor::Change change);
+
+  void rescan(const Producer& producer);
+
   void init();
   bool ready() const;
   void shutdown();
@@ -66,8 +76,10 @@ struct RepoManager
 
   Fmi::DirectoryMonitor itsMonitor;
   boost::thread itsMonitorThread;
+  InotifyMonitor itsInotifyMonitor;
+  boost::thread itsInotifyThread;
   boost::thread itsExpirationThread;
-  std::unique_ptr<Fmi::AsyncTaskGroup> updateTasks;
+  std::unique_ptr<LoadQueue> itsLoadQueue;
 
   // info on producers generated by constructor
 
@@ -97,12 +109,47 @@ struct RepoManager
 
  private:
   void load(Producer producer, Files files);
+  std::pair<SharedModel, bool> loadModel(const ProducerConfig& conf,
+                                         const std::filesystem::path& filename,
+                                         bool try_old_repo);
+  void adoptOldModels(const ProducerConfig& conf);
+  void handleChanges(const Producer& producer, Files removals, Files additions);
+  bool isLoaded(const Producer& producer, const std::filesystem::path& path) const;
+  bool isStable(const std::filesystem::path& path) const;
+  void markComplete(const std::filesystem::path& path);
+  bool isComplete(const std::filesystem::path& path);
+  void retryLater(const Producer& producer, const std::filesystem::path& path, bool failed);
+  void retryLoads();
+  void retireModifiedModels(const Producer& producer);
+  unsigned int scanInterval(const Producer& producer) const;
   void expirationLoop();
 
   Fmi::DirectoryMonitor::Watcher id(const Producer& producer) const;
 
   int itsMaxThreadCount;
-  boost::atomic<int> itsThreadCount;
+
+  // Directories on local file systems are watched with inotify and scanned rarely
+  bool itsInotifyEnabled = true;
+  unsigned int itsInotifyRescanInterval = 600;
+  std::set<Producer> itsInotifyProducers;
+
+  // Files still being written or which failed to load are retried with a backoff
+  struct Retry
+  {
+    Producer producer;
+    unsigned int failures = 0;
+    std::chrono::steady_clock::time_point next;
+  };
+
+  unsigned int itsStabilityProbes = 2;
+  unsigned int itsStabilityInterval = 200;  // milliseconds
+  unsigned int itsMaxRetries = 5;
+  unsigned int itsRetryDelay = 2;  // seconds, doubled after each failure
+  mutable std::mutex itsRetryMutex;
+  std::map<std::filesystem::path, Retry> itsRetries;
+
+  // Files inotify reported complete, and their modification times at the time
+  std::map<std::filesystem::path, std::time_t> itsCompleteFiles;
 
   using LatLonCache = Fmi::Cache::Cache<std::size_t, std::shared_ptr<std::vector<NFmiPoint>>>;
   LatLonCache itsLatLonCache;
@@ -5,7 +5,6 @@
 // ======================================================================
 
 #include "Repository.h"
-#include "MetaQueryFilters.h"
 #include <boost/algorithm/string/join.hpp>
 #include <macgyver/Exception.h>
 #include <macgyver/StringConversion.h>
@@ -13,7 +12,6 @@
 #include <newbase/NFmiQueryData.h>
 #include <spine/Convenience.h>
 #include <spine/TableFormatter.h>
-#include <timeseries/ParameterFactory.h>
 #include <cassert>
 #include <sstream>
 #include <stdexcept>
@@ -28,6 +26,28 @@ namespace
 {
 const Repository::SharedModels gNoModels;  // empty global so we can return a reference to it
 
+// Loaded models have their metadata precalculated, derived ones do not
+MetaData model_metadata(const SharedModel& theModel)
+{
+  auto meta = theModel->metaData();
+  if (meta)
+    return *meta;
+  QImpl q(theModel);
+  return q.metaData();
+}
+
+// Similarly for the admin content table fields
+ModelContentPtr model_content(const SharedModel& theModel)
+{
+  auto content = theModel->content();
+  if (content)
+    return content;
+  auto info = theModel->info();
+  content = ModelContent::create(*info);
+  theModel->release(info);
+  return content;
+}
+
 bool latest_model_age_ok(const Repository::SharedModels& time_models, unsigned int max_latest_age)
 {
   if (time_models.empty())
@@ -125,6 +145,8 @@ void Repository::add(const Producer& producer, const SharedModel& model)
                 << " with hash value " << hash_value(*model) << '\n';
     }
 
+    invalidateMetaDataIndex();
+
     auto producer_model = itsProducers.find(producer);
 
     // Establish the model map for the producer
@@ -497,6 +519,7 @@ void Repository::remove(const Producer& producer, const std::filesystem::path& p
                     << time_model->second->path() << '\n';
         time_model->second->uncache();  // uncache validpoints
         models.erase(time_model);
+        invalidateMetaDataIndex();
         break;
       }
     }
@@ -542,6 +565,7 @@ void Repository::resize(const Producer& producer, std::size_t limit)
       // the oldest file is the one first sorted by origintime
       models.begin()->second->uncache();  // uncache validpoints
       models.erase(models.begin());       // and erase the model
+      invalidateMetaDataIndex();
     }
   }
   catch (...)
@@ -589,6 +613,7 @@ void Repository::expire(const Producer& producer, std::size_t max_age)
                     << time_model->second->path() << '\n';
         time_model->second->uncache();  // uncache validpoints
         models.erase(time_model++);
+        invalidateMetaDataIndex();
       }
     }
   }
@@ -693,6 +718,7 @@ Repository::ContentTable Repository::getProducerInfo(const ProducerList& produce
                                                 "NextScanTime",
                                                 "DataLoadTime",
                                                 "NumberOfLoadedFiles",
+                                                "NumberOfQueuedFiles",
                                                 "aliases",
                                                 "directory",
                                                 "pattern",
@@ -709,7 +735,9 @@ Repository::ContentTable Repository::getProducerInfo(const ProducerList& produce
                                                 "update_interval",
                                                 "minimum_expires",
                                                 "max_age",
-                                                "maxdistance"};
+                                                "maxdistance",
+                                                "load_priority",
+                                                "load_parallelism"};
 
     std::unique_ptr<Fmi::TimeFormatter> timeFormatter(Fmi::TimeFormatter::create(timeFormat));
 
@@ -750,6 +778,10 @@ Repository::ContentTable Repository::getProducerInfo(const ProducerList& produce
         // Number of loaded files
         resultTable->set(column, row, Fmi::to_string(status.number_of_loaded_files));
         ++column;
+
+        // Number of files waiting to be loaded
+        resultTable->set(column, row, Fmi::to_string(status.number_of_queued_files));
+        ++column;
       }
       else
       {
@@ -768,6 +800,10 @@ Repository::ContentTable Repository::getProducerInfo(const ProducerList& produce
         // Number of loaded files
         resultTable->set(column, row, "");
         ++column;
+
+        // Number of files waiting to be loaded
+        resultTable->set(column, row, "");
+        ++column;
       }
 
       // Configuration
@@ -804,6 +840,10 @@ Repository::ContentTable Repository::getProducerInfo(const ProducerList& produce
       resultTable->set(column, row, Fmi::to_string(thisConfig.max_age));
       ++column;
       resultTable->set(column, row, Fmi::to_string(thisConfig.maxdistance));
+      ++column;
+      resultTable->set(column, row, Fmi::to_string(thisConfig.load_priority));
+      ++column;
+      resultTable->set(column, row, Fmi::to_string(thisConfig.load_parallelism));
 
       row++;
     }
@@ -837,10 +877,10 @@ Repository::ContentTable Repository::getParameterInfo(const ProducerList& produc
       if (producer_model == itsProducers.end() || producer_model->second.empty())
         continue;
 
-      Q q = get(producer);
-      q->resetParam();
-      while (q->nextParam())
-        pip[q->parameterName()].push_back(producer);
+      // All models of a producer have the same parameters, use the newest one
+      const auto content = model_content(producer_model->second.rbegin()->second);
+      for (auto param : content->parameterIds)
+        pip[param].push_back(producer);
     }
 
     unsigned int row = 0;
@@ -921,55 +961,9 @@ Repository::ContentTable Repository::getRepoContents(const std::string& producer
 
       for (const auto& modit : theseModels)
       {
-        auto model = modit.second;
-        auto qi = model->info();
-
-        // Time range
-        qi->FirstTime();
-        Fmi::DateTime time1 = qi->ValidTime();
-        qi->LastTime();
-        Fmi::DateTime time2 = qi->ValidTime();
-        // File load time
-        Fmi::DateTime time3 = model->loadTime();
-
-        // Get the parameter list from querydatainfo
-        std::list<std::string> params;
-        std::list<std::string> descriptions;
-        for (qi->ResetParam(); qi->NextParam(false);)
-        {
-          int paramID = boost::numeric_cast<int>(qi->Param().GetParamIdent());
-          std::string paramName = TimeSeries::ParameterFactory::instance().name(paramID);
-          if (!paramName.empty())
-            params.push_back(paramName);
-          else
-            params.emplace_back(Fmi::to_string(paramID));
-
-          descriptions.emplace_back(qi->Param().GetParamName().CharPtr());
-        }
-
-        // Get the available levelvalues
-        std::list<std::string> levels;
-        for (qi->ResetLevel(); qi->NextLevel();)
-        {
-          float level = qi->Level()->LevelValue();
-          if (level != kFloatMissing)
-            levels.emplace_back(Fmi::to_string(level));
-          else
-            levels.emplace_back("-");
-        }
-
-        // Get projection string
-        std::string projectionText;
-        if (qi->Area() == nullptr)
-          projectionText = "nan";
-        else if (projectionFormat == "wkt")
-          projectionText = qi->Area()->WKT();
-        else
-          projectionText = qi->Area()->ProjStr();
-
-        // For nicer output in browsers we replace for example ",PROJCS" with ", PROJCS"
-        boost::regex rex(",([A-Z])");
-        projectionText = boost::regex_replace(projectionText, rex, ", $1");
+        const auto& model = modit.second;
+        const auto content = model_content(model);
+        const auto& projectionText = (projectionFormat == "wkt" ? content->wkt : content->proj);
 
         // Create the table
 
@@ -993,18 +987,15 @@ Repository::ContentTable Repository::getRepoContents(const std::string& producer
         ++column;
 
         // Insert parameters
-        std::string parameters = boost::algorithm::join(params, ", ");
-        resultTable->set(column, row, parameters);
+        resultTable->set(column, row, content->parameters);
         ++column;
 
         // Insert parameter descriptions
-        std::string descs = boost::algorithm::join(descriptions, ", ");
-        resultTable->set(column, row, descs);
+        resultTable->set(column, row, content->descriptions);
         ++column;
 
         // Insert levels
-        std::string levs = boost::algorithm::join(levels, ", ");
-        resultTable->set(column, row, levs);
+        resultTable->set(column, row, content->levels);
         ++column;
 
         // Insert projection string
@@ -1016,15 +1007,15 @@ Repository::ContentTable Repository::getRepoContents(const std::string& producer
         ++column;
 
         // Insert min time
-        resultTable->set(column, row, timeFormatter->format(time1));
+        resultTable->set(column, row, timeFormatter->format(content->minTime));
         ++column;
 
         // Insert max time
-        resultTable->set(column, row, timeFormatter->format(time2));
+        resultTable->set(column, row, timeFormatter->format(content->maxTime));
         ++column;
 
         // Insert file laod time
-        resultTable->set(column, row, timeFormatter->format(time3));
+        resultTable->set(column, row, timeFormatter->format(model->loadTime()));
         ++column;
 
         ++row;
@@ -1054,78 +1045,43 @@ std::list<MetaData> Repository::getRepoMetadata(const MetaQueryOptions& theOptio
 {
   try
   {
-    std::list<MetaData> propertyList;
-
-    // Avoid processing all metadata if producer and possibly origintime too are known,
-    // collecting all metadata may be quite slow
+    return metaDataIndex()->query(theOptions);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
 
-    if (theOptions.hasProducer())
-    {
-      if (theOptions.hasOriginTime())
-        propertyList = getRepoMetadata(theOptions.getProducer(), theOptions.getOriginTime());
-      else
-        propertyList = getRepoMetadata(theOptions.getProducer());
-    }
-    else
-      propertyList = getRepoMetadata();
+// ----------------------------------------------------------------------
+/*!
+ * \brief Return the metadata index, building it if necessary
+ */
+// ----------------------------------------------------------------------
 
-    // Filter according to the given options. Producer and origintime filters
-    // might have been used already, but at this point the tests fail quickly,
-    // not worth optimizing.
+std::shared_ptr<const MetaDataIndex> Repository::metaDataIndex() const
+{
+  try
+  {
+    std::lock_guard<std::mutex> lock(itsMetaDataIndexMutex);
+    if (itsMetaDataIndex)
+      return itsMetaDataIndex;
 
-    for (auto iter = propertyList.begin(); iter != propertyList.end();)
+    auto index = std::make_shared<MetaDataIndex>();
+    for (const auto& producer_models : itsProducers)
     {
-      if (!filterProducer(*iter, theOptions))
-      {
-        propertyList.erase(iter++);
-        continue;
-      }
-      if (!filterOriginTime(*iter, theOptions))
+      for (const auto& origintime_model : producer_models.second)
       {
-        propertyList.erase(iter++);
-        continue;
-      }
-
-      if (!filterFirstTime(*iter, theOptions))
-      {
-        propertyList.erase(iter++);
-        continue;
+        const auto& model = origintime_model.second;
+        auto meta = model->metaData();
+        if (!meta)
+          meta = std::make_shared<const MetaData>(model_metadata(model));
+        index->add(meta);
       }
-
-      if (!filterLastTime(*iter, theOptions))
-      {
-        propertyList.erase(iter++);
-        continue;
-      }
-
-      if (!filterParameters(*iter, theOptions))
-      {
-        propertyList.erase(iter++);
-        continue;
-      }
-
-      if (!filterLevelTypes(*iter, theOptions))
-      {
-        propertyList.erase(iter++);
-        continue;
-      }
-
-      if (!filterLevelValues(*iter, theOptions))
-      {
-        propertyList.erase(iter++);
-        continue;
-      }
-
-      if (!filterBoundingBox(*iter, theOptions))
-      {
-        propertyList.erase(iter++);
-        continue;
-      }
-
-      ++iter;
     }
 
-    return propertyList;
+    itsMetaDataIndex = index;
+    return itsMetaDataIndex;
   }
   catch (...)
   {
@@ -1133,6 +1089,12 @@ std::list<MetaData> Repository::getRepoMetadata(const MetaQueryOptions& theOptio
   }
 }
 
+void Repository::invalidateMetaDataIndex()
+{
+  std::lock_guard<std::mutex> lock(itsMetaDataIndexMutex);
+  itsMetaDataIndex.reset();
+}
+
 std::list<MetaData> Repository::getRepoMetadata(const std::string& producer) const
 {
   try
@@ -1147,8 +1109,7 @@ std::list<MetaData> Repository::getRepoMetadata(const std::string& producer) con
 
     for (const auto& origintime_model : models)
     {
-      QImpl q(origintime_model.second);
-      props.push_back(q.metaData());
+      props.push_back(model_metadata(origintime_model.second));
     }
     return props;
   }
@@ -1175,8 +1136,7 @@ std::list<MetaData> Repository::getRepoMetadata(const std::string& producer,
     if (modelpos == models.end())
       return props;
 
-    QImpl q(modelpos->second);
-    props.push_back(q.metaData());
+    props.push_back(model_metadata(modelpos->second));
 
     return props;
   }
@@ -1198,8 +1158,7 @@ std::list<MetaData> Repository::getRepoMetadata() const
 
       for (const auto& origintime_model : models)
       {
-        QImpl q(origintime_model.second);
-        props.push_back(q.metaData());
+        props.push_back(model_metadata(origintime_model.second));
       }
     }
 
@@ -1304,6 +1263,11 @@ void Repository::updateProducerStatus(const std::string& producer,
   ps.number_of_loaded_files = nFiles;
 }
 
+void Repository::updateProducerQueue(const std::string& producer, std::size_t nFiles)
+{
+  itsProducerStatus[producer].number_of_queued_files = nFiles;
+}
+
 void Repository::verbose(bool flag)
 {
   itsVerbose = flag;
@@ -7,6 +7,7 @@
 #pragma once
 
 #include "MetaData.h"
+#include "MetaDataIndex.h"
 #include "MetaQueryOptions.h"
 #include "Model.h"
 #include "OriginTime.h"
@@ -15,6 +16,7 @@
 
 #include <macgyver/DateTime.h>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <string>
 #include <utility>
@@ -35,6 +37,7 @@ struct ProducerStatus
   Fmi::DateTime next_scan_time{Fmi::DateTime::NOT_A_DATE_TIME};
   Fmi::DateTime latest_data_load_time{Fmi::DateTime::NOT_A_DATE_TIME};
   unsigned int number_of_loaded_files{0};
+  std::size_t number_of_queued_files{0};
 };
 
 class Repository
@@ -103,6 +106,7 @@ class Repository
   void updateProducerStatus(const std::string& producer,
                             const Fmi::DateTime& dataLoadTime,
                             unsigned int nFiles);
+  void updateProducerQueue(const std::string& producer, std::size_t nFiles);
 
   void verbose(bool flag);
 
@@ -125,6 +129,13 @@ class Repository
 
   const SharedModels& findProducer(const std::string& producer) const;
 
+  // Index for metadata queries, built on demand after any change to the models
+  std::shared_ptr<const MetaDataIndex> metaDataIndex() const;
+  void invalidateMetaDataIndex();
+
+  mutable std::mutex itsMetaDataIndexMutex;
+  mutable std::shared_ptr<const MetaDataIndex> itsMetaDataIndex;
+
 };  // class Repository
 
 }  // namespace Querydata
@@ -0,0 +1,259 @@
+#include "SampleCache.h"
+#include <macgyver/Exception.h>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Querydata
+{
+namespace
+{
+// Size of the sampled data in bytes
+std::size_t data_size(const Q& theQ)
+{
+  auto info = theQ->info();
+  return sizeof(float) * info->SizeParams() * info->SizeTimes() * info->SizeLevels() *
+         info->SizeLocations();
+}
+}  // namespace
+
+SampleCache::SampleCache(std::size_t theMaxBytes)
+    : itsMaxBytes(theMaxBytes), itsStartTime(Fmi::SecondClock::universal_time())
+{
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Change the maximum size of the cache in bytes
+ */
+// ----------------------------------------------------------------------
+
+void SampleCache::resize(std::size_t theMaxBytes)
+{
+  try
+  {
+    Spine::WriteLock lock(itsMutex);
+    itsMaxBytes = theMaxBytes;
+    purge();
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Return the sample for the hash, creating it if necessary
+ *
+ * The first caller creates the sample, later callers wait for the
+ * same result and get their own Q for it. A failed calculation is
+ * not cached.
+ */
+// ----------------------------------------------------------------------
+
+Q SampleCache::get(std::size_t theHash, const Q& theSource, const std::function<Q()>& theFactory)
+{
+  try
+  {
+    std::promise<SharedModel> promise;
+    std::size_t generation = 0;
+
+    {
+      Spine::WriteLock lock(itsMutex);
+
+      // The source models must be the ones the caller got from the repository
+      auto pos = itsEntries.find(theHash);
+      if (pos != itsEntries.end() && !expired(pos->second) && sameSources(pos->second, theSource))
+      {
+        ++itsHits;
+        itsLRU.splice(itsLRU.begin(), itsLRU, pos->second.lru);
+        auto result = pos->second.result;
+        lock.unlock();
+        return std::make_shared<QImpl>(result.get());
+      }
+
+      if (pos != itsEntries.end())
+        erase(pos);
+
+      ++itsMisses;
+      ++itsInserts;
+
+      Entry entry;
+      entry.result = promise.get_future().share();
+      for (const auto& model : theSource->models())
+        entry.sources.emplace_back(model);
+      entry.generation = generation = ++itsGeneration;
+      itsLRU.push_front(theHash);
+      entry.lru = itsLRU.begin();
+      itsEntries.emplace(theHash, std::move(entry));
+    }
+
+    try
+    {
+      auto q = theFactory();
+      const auto bytes = data_size(q);
+      promise.set_value(q->models().front());
+
+      Spine::WriteLock lock(itsMutex);
+      auto pos = itsEntries.find(theHash);
+      if (pos != itsEntries.end() && pos->second.generation == generation)
+      {
+        pos->second.bytes = bytes;
+        itsBytes += bytes;
+        purge();
+      }
+      return q;
+    }
+    catch (...)
+    {
+      promise.set_exception(std::current_exception());
+
+      Spine::WriteLock lock(itsMutex);
+      auto pos = itsEntries.find(theHash);
+      if (pos != itsEntries.end() && pos->second.generation == generation)
+        erase(pos);
+      throw;
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Remove entries whose source models are no longer loaded
+ *
+ * Called periodically so that samples of removed data do not wait for
+ * the next insert to be released. The predicate is called unlocked,
+ * since it may need to lock the repository.
+ */
+// ----------------------------------------------------------------------
+
+void SampleCache::expire(const std::function<bool(const SharedModel&)>& theIsLoaded)
+{
+  try
+  {
+    struct Candidate
+    {
+      std::size_t hash;
+      std::size_t generation;
+      std::vector<std::weak_ptr<Model>> sources;
+    };
+
+    std::vector<Candidate> candidates;
+    {
+      Spine::ReadLock lock(itsMutex);
+      for (const auto& hash_entry : itsEntries)
+      {
+        const auto& entry = hash_entry.second;
+        candidates.push_back(Candidate{hash_entry.first, entry.generation, entry.sources});
+      }
+    }
+
+    std::vector<Candidate> removed;
+    for (auto& candidate : candidates)
+    {
+      for (const auto& source : candidate.sources)
+      {
+        auto model = source.lock();
+        if (!model || !theIsLoaded(model))
+        {
+          removed.push_back(std::move(candidate));
+          break;
+        }
+      }
+    }
+
+    if (removed.empty())
+      return;
+
+    Spine::WriteLock lock(itsMutex);
+    for (const auto& candidate : removed)
+    {
+      auto pos = itsEntries.find(candidate.hash);
+      if (pos != itsEntries.end() && pos->second.generation == candidate.generation)
+        erase(pos);
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Report cache statistics, sizes are in bytes
+ */
+// ----------------------------------------------------------------------
+
+Fmi::Cache::CacheStats SampleCache::statistics() const
+{
+  Spine::ReadLock lock(itsMutex);
+
+  Fmi::Cache::CacheStats stats;
+  stats.starttime = itsStartTime;
+  stats.maxsize = itsMaxBytes;
+  stats.size = itsBytes;
+  stats.inserts = itsInserts;
+  stats.hits = itsHits;
+  stats.misses = itsMisses;
+  return stats;
+}
+
+// An entry is useless once a source model has been removed from the repository
+bool SampleCache::expired(const Entry& theEntry)
+{
+  for (const auto& model : theEntry.sources)
+    if (model.expired())
+      return true;
+  return false;
+}
+
+// A model replaced in the repository by another one with the same hash must not be used
+bool SampleCache::sameSources(const Entry& theEntry, const Q& theSource)
+{
+  const auto& models = theSource->models();
+  if (models.size() != theEntry.sources.size())
+    return false;
+  for (std::size_t i = 0; i < models.size(); i++)
+    if (theEntry.sources[i].lock() != models[i])
+      return false;
+  return true;
+}
+
+void SampleCache::erase(Entries::iterator theEntry)
+{
+  itsBytes -= theEntry->second.bytes;
+  itsLRU.erase(theEntry->second.lru);
+  itsEntries.erase(theEntry);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Remove expired entries and the least recently used ones until
+ *        the cache fits into the size limit. Must be called locked.
+ */
+// ----------------------------------------------------------------------
+
+void SampleCache::purge()
+{
+  for (auto pos = itsEntries.begin(); pos != itsEntries.end();)
+  {
+    auto next = std::next(pos);
+    if (expired(pos->second))
+      erase(pos);
+    pos = next;
+  }
+
+  while (itsBytes > itsMaxBytes && !itsLRU.empty())
+    erase(itsEntries.find(itsLRU.back()));
+}
+
+}  // namespace Querydata
+}  // namespace Engine
+}  // namespace SmartMet
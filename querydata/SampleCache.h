@@ -0,0 +1,84 @@
+// ======================================================================
+/*!
+ * \brief Cache for data resampled with QImpl::sample
+ *
+ * Sampled grids may be large, hence the cache is limited by the total
+ * size of the data instead of the number of entries. Concurrent
+ * requests for the same sample wait for a single calculation. Entries
+ * are discarded once any of the source models has been deleted or has
+ * been removed from the repository.
+ *
+ * The sampled model is cached instead of the Q, since a Q owns an
+ * iterator and must not be shared between threads.
+ */
+// ======================================================================
+
+#pragma once
+
+#include "Model.h"
+#include "Q.h"
+#include <macgyver/Cache.h>
+#include <macgyver/DateTime.h>
+#include <spine/Thread.h>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Querydata
+{
+class SampleCache
+{
+ public:
+  explicit SampleCache(std::size_t theMaxBytes);
+
+  void resize(std::size_t theMaxBytes);
+
+  // Return a new Q for the cached sample or create it with the given function
+  Q get(std::size_t theHash, const Q& theSource, const std::function<Q()>& theFactory);
+
+  // Remove entries for which some source model is no longer loaded
+  void expire(const std::function<bool(const SharedModel&)>& theIsLoaded);
+
+  Fmi::Cache::CacheStats statistics() const;
+
+ private:
+  struct Entry
+  {
+    std::shared_future<SharedModel> result;
+    std::vector<std::weak_ptr<Model>> sources;
+    std::size_t bytes = 0;  // zero until the sample is ready
+    std::size_t generation = 0;
+    std::list<std::size_t>::iterator lru;
+  };
+
+  using Entries = std::unordered_map<std::size_t, Entry>;
+
+  static bool expired(const Entry& theEntry);
+  static bool sameSources(const Entry& theEntry, const Q& theSource);
+  void erase(Entries::iterator theEntry);
+  void purge();
+
+  mutable Spine::MutexType itsMutex;
+  Entries itsEntries;
+  std::list<std::size_t> itsLRU;  // most recently used first
+
+  std::size_t itsMaxBytes;
+  std::size_t itsBytes = 0;
+  std::size_t itsGeneration = 0;
+
+  Fmi::DateTime itsStartTime;
+  std::size_t itsHits = 0;
+  std::size_t itsMisses = 0;
+  std::size_t itsInserts = 0;
+};
+
+}  // namespace Querydata
+}  // namespace Engine
+}  // namespace SmartMet
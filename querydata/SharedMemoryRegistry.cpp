@@ -0,0 +1,333 @@
+#include "SharedMemoryRegistry.h"
+#include "CoordinateBlob.h"
+#include <fmt/format.h>
+#include <macgyver/Exception.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <ctime>
+#include <fcntl.h>
+#include <filesystem>
+#include <unistd.h>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Querydata
+{
+namespace SharedMemoryRegistry
+{
+namespace
+{
+std::atomic<bool> g_Enabled{false};
+std::string g_Prefix;
+std::size_t g_MaxBytes = 0;
+
+// Where Linux exposes the POSIX shared memory segments
+const char* shm_directory = "/dev/shm";
+
+// Incomplete or unreadable segments older than this are abandoned
+const int stale_seconds = 60;
+
+std::string segment_name(CoordinateBlob::Kind theKind, std::size_t theHash)
+{
+  const char* type = (theKind == CoordinateBlob::Kind::LatLons ? "ll" : "xy");
+  return fmt::format("{}-{}-{:016x}", g_Prefix, type, theHash);
+}
+
+std::size_t points(const Fmi::CoordinateMatrix& theData)
+{
+  return theData.width() * theData.height();
+}
+
+std::size_t points(const std::vector<NFmiPoint>& theData)
+{
+  return theData.size();
+}
+
+// Only segments created by the same user without access for others are used
+bool trusted(const struct stat& theStat)
+{
+  return theStat.st_uid == geteuid() && (theStat.st_mode & 077) == 0;
+}
+
+bool stale(const struct stat& theStat)
+{
+  return std::time(nullptr) - theStat.st_mtime > stale_seconds;
+}
+
+// Test whether the file name is exactly that of a segment with the configured prefix
+bool is_segment(const std::string& theFilename)
+{
+  // Names are {prefix}-{ll|xy}-{16 hex digits}, the prefix without the leading slash
+  const auto stem = g_Prefix.substr(1) + "-";
+  if (theFilename.size() != stem.size() + 19 || theFilename.compare(0, stem.size(), stem) != 0)
+    return false;
+
+  const auto type = theFilename.substr(stem.size(), 3);
+  if (type != "ll-" && type != "xy-")
+    return false;
+
+  return std::all_of(theFilename.begin() + static_cast<std::ptrdiff_t>(stem.size() + 3),
+                     theFilename.end(),
+                     [](char c) { return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'); });
+}
+
+// Unlink the segment only if the name still refers to the open segment, since another
+// process may have replaced it meanwhile. Must be called while the descriptor is open.
+bool unlink_if_same(const std::string& theName, const struct stat& theStat)
+{
+  struct stat st;
+  const auto path = std::string(shm_directory) + theName;
+  if (stat(path.c_str(), &st) != 0 || st.st_dev != theStat.st_dev || st.st_ino != theStat.st_ino)
+    return false;
+  return shm_unlink(theName.c_str()) == 0;
+}
+
+// Remove a segment left incomplete by a crashed writer or written by another format version
+bool remove_if_stale(CoordinateBlob::Kind theKind, std::size_t theHash)
+{
+  const auto name = segment_name(theKind, theHash);
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0)
+    return false;
+
+  bool removed = false;
+  try
+  {
+    struct stat st;
+    if (fstat(fd, &st) == 0 && trusted(st) && stale(st) &&
+        !CoordinateBlob::valid(fd, theKind, theHash))
+      removed = unlink_if_same(name, st);
+  }
+  catch (...)
+  {
+    close(fd);
+    throw;
+  }
+  close(fd);
+
+  return removed;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Remove the least recently used segments to make room
+ *
+ * The limit is shared by all processes using the same prefix. Segments
+ * are touched when read, hence the modification time tells when they
+ * were last used. Returns false if the new segment cannot fit at all.
+ */
+// ----------------------------------------------------------------------
+
+bool make_room(std::size_t theBytes)
+{
+  if (g_MaxBytes == 0)
+    return true;
+  if (theBytes > g_MaxBytes)
+    return false;
+
+  struct Segment
+  {
+    std::time_t used;
+    std::size_t bytes;
+    std::string name;
+  };
+
+  std::vector<Segment> segments;
+  std::size_t total = 0;
+
+  std::error_code ec;
+  for (const auto& entry : std::filesystem::directory_iterator(shm_directory, ec))
+  {
+    // Other prefixes may start with the same characters
+    const auto filename = entry.path().filename().string();
+    if (!is_segment(filename))
+      continue;
+
+    struct stat st;
+    if (stat(entry.path().c_str(), &st) != 0 || !trusted(st))
+      continue;
+
+    const auto bytes = static_cast<std::size_t>(st.st_size);
+    segments.push_back(Segment{st.st_mtime, bytes, "/" + filename});
+    total += bytes;
+  }
+
+  std::sort(segments.begin(),
+            segments.end(),
+            [](const Segment& a, const Segment& b) { return a.used < b.used; });
+
+  for (const auto& segment : segments)
+  {
+    if (total + theBytes <= g_MaxBytes)
+      break;
+    if (shm_unlink(segment.name.c_str()) == 0)
+      total -= segment.bytes;
+  }
+
+  return total + theBytes <= g_MaxBytes;
+}
+
+// Read an existing segment. Unusable segments are ignored, and removed once stale.
+template <typename Reader>
+auto find(CoordinateBlob::Kind theKind, std::size_t theHash, Reader theReader)
+    -> decltype(theReader(0, 0))
+{
+  if (!g_Enabled)
+    return {};
+
+  const auto name = segment_name(theKind, theHash);
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0)
+    return {};
+
+  try
+  {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !trusted(st))
+    {
+      close(fd);
+      return {};
+    }
+
+    auto ret = theReader(fd, theHash);
+    if (ret)
+      futimens(fd, nullptr);  // mark as recently used
+    else if (stale(st))
+      unlink_if_same(name, st);
+    close(fd);
+    return ret;
+  }
+  catch (...)
+  {
+    close(fd);
+    throw;
+  }
+}
+
+// Create a new segment unless some other process already did
+template <typename Data>
+void publish(CoordinateBlob::Kind theKind, std::size_t theHash, const Data& theData)
+{
+  if (!g_Enabled)
+    return;
+
+  const auto name = segment_name(theKind, theHash);
+  const auto bytes = CoordinateBlob::size(points(theData));
+
+  int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0)
+  {
+    if (errno != EEXIST || !remove_if_stale(theKind, theHash))
+      return;
+    fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+      return;
+  }
+
+  try
+  {
+    const bool ok = (make_room(bytes) && CoordinateBlob::write(fd, theKind, theHash, theData));
+    close(fd);
+    if (!ok)
+      shm_unlink(name.c_str());
+  }
+  catch (...)
+  {
+    close(fd);
+    shm_unlink(name.c_str());
+    throw;
+  }
+}
+
+}  // namespace
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Enable the registry
+ *
+ * Must be called before any other thread uses the registry. All the
+ * processes sharing data must use the same prefix, which must start
+ * with a slash and contain no other slashes. Zero size means no limit.
+ */
+// ----------------------------------------------------------------------
+
+void Enable(const std::string& thePrefix, std::size_t theMaxBytes)
+{
+  if (thePrefix.empty() || thePrefix[0] != '/' || thePrefix.find('/', 1) != std::string::npos)
+    throw Fmi::Exception(BCP, "Invalid shared memory name prefix")
+        .addParameter("prefix", thePrefix);
+  g_Prefix = thePrefix;
+  g_MaxBytes = theMaxBytes;
+  g_Enabled = true;
+}
+
+bool Enabled()
+{
+  return g_Enabled;
+}
+
+std::shared_ptr<Fmi::CoordinateMatrix> FindCoordinates(std::size_t theHash,
+                                                       std::size_t theWidth,
+                                                       std::size_t theHeight)
+{
+  try
+  {
+    return find(CoordinateBlob::Kind::Coordinates,
+                theHash,
+                [theWidth, theHeight](int fd, std::size_t key)
+                { return CoordinateBlob::readCoordinates(fd, key, theWidth, theHeight); });
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+void PublishCoordinates(std::size_t theHash, const Fmi::CoordinateMatrix& theCoordinates)
+{
+  try
+  {
+    publish(CoordinateBlob::Kind::Coordinates, theHash, theCoordinates);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+std::shared_ptr<std::vector<NFmiPoint>> FindLatLons(std::size_t theHash, std::size_t thePoints)
+{
+  try
+  {
+    return find(CoordinateBlob::Kind::LatLons,
+                theHash,
+                [thePoints](int fd, std::size_t key)
+                { return CoordinateBlob::readLatLons(fd, key, thePoints); });
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+void PublishLatLons(std::size_t theHash, const std::vector<NFmiPoint>& theLatLons)
+{
+  try
+  {
+    publish(CoordinateBlob::Kind::LatLons, theHash, theLatLons);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+}  // namespace SharedMemoryRegistry
+}  // namespace Querydata
+}  // namespace Engine
+}  // namespace SmartMet
@@ -0,0 +1,48 @@
+// ======================================================================
+/*!
+ * \brief Host-local registry of coordinate data in POSIX shared memory
+ *
+ * Several server processes on the same host load the same querydata
+ * and calculate identical latlon caches and projected coordinates. When
+ * enabled, the first process to calculate such data publishes it as a
+ * shared memory segment named by the hash of the data, and the other
+ * processes read it from there instead of recalculating. Segments are
+ * never modified once complete. Only segments owned by the same user
+ * are trusted, and the least recently used ones are removed when the
+ * total size would exceed the limit.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <gis/CoordinateMatrix.h>
+#include <newbase/NFmiPoint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Querydata
+{
+namespace SharedMemoryRegistry
+{
+// Disabled until a name prefix has been set
+void Enable(const std::string& thePrefix, std::size_t theMaxBytes);
+bool Enabled();
+
+// The expected size is checked to guard against corrupt data and hash collisions
+std::shared_ptr<Fmi::CoordinateMatrix> FindCoordinates(std::size_t theHash,
+                                                       std::size_t theWidth,
+                                                       std::size_t theHeight);
+void PublishCoordinates(std::size_t theHash, const Fmi::CoordinateMatrix& theCoordinates);
+
+std::shared_ptr<std::vector<NFmiPoint>> FindLatLons(std::size_t theHash, std::size_t thePoints);
+void PublishLatLons(std::size_t theHash, const std::vector<NFmiPoint>& theLatLons);
+
+}  // namespace SharedMemoryRegistry
+}  // namespace Querydata
+}  // namespace Engine
+}  // namespace SmartMet
@@ -0,0 +1,49 @@
+#include "ValuesView.h"
+#include <macgyver/Exception.h>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Querydata
+{
+ValuesView::ValuesView(SharedModel theModel,
+                       SharedInfo theInfo,
+                       std::size_t theBase,
+                       std::size_t theStride,
+                       std::size_t theWidth,
+                       std::size_t theHeight)
+    : itsModel(std::move(theModel)),
+      itsInfo(std::move(theInfo)),
+      itsBase(theBase),
+      itsStride(theStride),
+      itsWidth(theWidth),
+      itsHeight(theHeight)
+{
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Copy the viewed values into a matrix
+ */
+// ----------------------------------------------------------------------
+
+NFmiDataMatrix<float> ValuesView::values(bool theMissingAsNaN) const
+{
+  try
+  {
+    NFmiDataMatrix<float> ret(itsWidth, itsHeight);
+    for (std::size_t j = 0; j < itsHeight; j++)
+      for (std::size_t i = 0; i < itsWidth; i++)
+        ret[i][j] = (theMissingAsNaN ? nanValue(i, j) : (*this)(i, j));
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+}  // namespace Querydata
+}  // namespace Engine
+}  // namespace SmartMet
@@ -0,0 +1,78 @@
+// ======================================================================
+/*!
+ * \brief Read-only view to the values of one native grid
+ *
+ * The view reads one parameter, level and timestep directly from the
+ * querydata without copying it. The model is kept alive for as long
+ * as the view exists. Values are returned as stored, i.e. missing
+ * values are kFloatMissing unless the NaN accessors are used.
+ *
+ * No pointer to the values is exposed. newbase keeps them inside
+ * NFmiRawData, whose heap or memory mapped storage has no public
+ * accessor, so each value is read through the raw data index
+ * base + location * stride, the same arithmetic a pointer would need.
+ */
+// ======================================================================
+
+#pragma once
+
+#include "Model.h"
+#include <newbase/NFmiDataMatrix.h>
+#include <newbase/NFmiGlobals.h>
+#include <limits>
+#include <memory>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Querydata
+{
+class ValuesView
+{
+ public:
+  ValuesView(SharedModel theModel,
+             SharedInfo theInfo,
+             std::size_t theBase,
+             std::size_t theStride,
+             std::size_t theWidth,
+             std::size_t theHeight);
+
+  std::size_t NX() const { return itsWidth; }
+  std::size_t NY() const { return itsHeight; }
+  std::size_t size() const { return itsWidth * itsHeight; }
+
+  // Value by location index
+  float operator[](std::size_t theIndex) const
+  {
+    return itsInfo->GetFloatValue(itsBase + theIndex * itsStride);
+  }
+
+  // Value by grid coordinates
+  float operator()(std::size_t i, std::size_t j) const { return (*this)[j * itsWidth + i]; }
+
+  float nanValue(std::size_t theIndex) const
+  {
+    const float value = (*this)[theIndex];
+    return (value == kFloatMissing ? std::numeric_limits<float>::quiet_NaN() : value);
+  }
+
+  float nanValue(std::size_t i, std::size_t j) const { return nanValue(j * itsWidth + i); }
+
+  // Copy into a matrix for consumers which need one
+  NFmiDataMatrix<float> values(bool theMissingAsNaN = true) const;
+
+ private:
+  SharedModel itsModel;
+  SharedInfo itsInfo;
+  std::size_t itsBase;
+  std::size_t itsStride;
+  std::size_t itsWidth;
+  std::size_t itsHeight;
+};
+
+using ValuesViewPtr = std::shared_ptr<const ValuesView>;
+
+}  // namespace Querydata
+}  // namespace Engine
+}  // namespace SmartMet
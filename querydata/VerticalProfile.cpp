@@ -0,0 +1,150 @@
+#include "VerticalProfile.h"
+#include <macgyver/Exception.h>
+#include <newbase/NFmiGlobals.h>
+#include <cmath>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Querydata
+{
+namespace
+{
+// ----------------------------------------------------------------------
+/*!
+ * \brief Interpolate values between the two levels bracketing the coordinate
+ *
+ * The levels may be in ascending or descending order. Levels with a
+ * missing coordinate or value are skipped. The transform is applied
+ * to the coordinates before the interpolation weight is calculated.
+ */
+// ----------------------------------------------------------------------
+
+template <typename Transform>
+float interpolate(const std::vector<float>& theCoordinates,
+                  const std::vector<float>& theValues,
+                  float theCoordinate,
+                  Transform theTransform)
+{
+  if (theCoordinate == kFloatMissing)
+    return kFloatMissing;
+
+  const double x = theTransform(theCoordinate);
+
+  long previous = -1;
+  for (std::size_t i = 0; i < theCoordinates.size(); i++)
+  {
+    if (theCoordinates[i] == kFloatMissing || theValues[i] == kFloatMissing)
+      continue;
+
+    if (theCoordinates[i] == theCoordinate)
+      return theValues[i];
+
+    if (previous >= 0)
+    {
+      const double x1 = theTransform(theCoordinates[previous]);
+      const double x2 = theTransform(theCoordinates[i]);
+      if ((x1 < x && x < x2) || (x2 < x && x < x1))
+      {
+        const double w = (x - x1) / (x2 - x1);
+        return static_cast<float>((1 - w) * theValues[previous] + w * theValues[i]);
+      }
+    }
+    previous = static_cast<long>(i);
+  }
+
+  return kFloatMissing;
+}
+
+}  // namespace
+
+VerticalProfile::VerticalProfile(std::vector<float> thePressures, std::vector<float> theHeights)
+    : itsPressures(std::move(thePressures)), itsHeights(std::move(theHeights))
+{
+  if (itsPressures.size() != itsHeights.size())
+    throw Fmi::Exception(BCP, "Pressure and height columns of a profile must be of equal size");
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Store the native level values of a parameter
+ */
+// ----------------------------------------------------------------------
+
+void VerticalProfile::set(FmiParameterName theParam, std::vector<float> theValues)
+{
+  try
+  {
+    if (theValues.size() != levelCount())
+      throw Fmi::Exception(BCP, "Profile values do not match the number of levels")
+          .addParameter("Parameter", std::to_string(theParam));
+    itsValues[theParam] = std::move(theValues);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+bool VerticalProfile::has(FmiParameterName theParam) const
+{
+  return itsValues.find(theParam) != itsValues.end();
+}
+
+const std::vector<float>* VerticalProfile::values(FmiParameterName theParam) const
+{
+  auto pos = itsValues.find(theParam);
+  if (pos == itsValues.end())
+    return nullptr;
+  return &pos->second;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Value of a parameter at the given pressure
+ */
+// ----------------------------------------------------------------------
+
+float VerticalProfile::valueAtPressure(FmiParameterName theParam, float thePressure) const
+{
+  try
+  {
+    const auto* vals = values(theParam);
+    if (vals == nullptr || thePressure <= 0)
+      return kFloatMissing;
+
+    return interpolate(
+        itsPressures, *vals, thePressure, [](float p) { return std::log(static_cast<double>(p)); });
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Value of a parameter at the given height
+ */
+// ----------------------------------------------------------------------
+
+float VerticalProfile::valueAtHeight(FmiParameterName theParam, float theHeight) const
+{
+  try
+  {
+    const auto* vals = values(theParam);
+    if (vals == nullptr)
+      return kFloatMissing;
+
+    return interpolate(itsHeights, *vals, theHeight, [](float h) { return static_cast<double>(h); });
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+}  // namespace Querydata
+}  // namespace Engine
+}  // namespace SmartMet
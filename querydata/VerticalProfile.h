@@ -0,0 +1,60 @@
+// ======================================================================
+/*!
+ * \brief Vertical profile of several parameters at one point and time
+ *
+ * The native level values are interpolated horizontally and in time
+ * only once per level. The pressure and height of each level are
+ * stored as coordinate columns, so that any number of pressure or
+ * height lookups can be answered from the profile without touching
+ * the querydata again.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <newbase/NFmiParameterName.h>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Querydata
+{
+class VerticalProfile
+{
+ public:
+  VerticalProfile(std::vector<float> thePressures, std::vector<float> theHeights);
+
+  std::size_t levelCount() const { return itsPressures.size(); }
+
+  // Coordinate columns in native level order, kFloatMissing if unknown
+  const std::vector<float>& pressures() const { return itsPressures; }
+  const std::vector<float>& heights() const { return itsHeights; }
+
+  void set(FmiParameterName theParam, std::vector<float> theValues);
+
+  bool has(FmiParameterName theParam) const;
+
+  // Native level values or nullptr if the parameter was not extracted
+  const std::vector<float>* values(FmiParameterName theParam) const;
+
+  // Logarithmic interpolation in pressure (hPa)
+  float valueAtPressure(FmiParameterName theParam, float thePressure) const;
+
+  // Linear interpolation in height (meters)
+  float valueAtHeight(FmiParameterName theParam, float theHeight) const;
+
+ private:
+  std::vector<float> itsPressures;
+  std::vector<float> itsHeights;
+  std::map<FmiParameterName, std::vector<float>> itsValues;
+};
+
+using VerticalProfilePtr = std::shared_ptr<const VerticalProfile>;
+
+}  // namespace Querydata
+}  // namespace Engine
+}  // namespace SmartMet